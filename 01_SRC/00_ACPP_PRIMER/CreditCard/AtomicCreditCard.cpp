@@ -0,0 +1,56 @@
+
+/**
+ * The file AtomicCreditCard.cpp, which contains the defintion of out-of-class member functions
+ * for class AtomicCreditCard
+ */
+
+#include "AtomicCreditCard.h"
+
+using namespace std;
+
+AtomicCreditCard::AtomicCreditCard(const string& no, const string& nm, Money lim, Money bal)
+    : number(no), name(nm), limit(lim), balance(bal.getCents())
+{
+}
+
+bool AtomicCreditCard::chargelt(Money price)
+{
+    int64_t current = balance.load(memory_order_relaxed);
+    Money   after;
+
+    // on failure compare_exchange_weak reloads current, so the limit is checked
+    // again against the balance that the other thread has just written
+    do
+    {
+        after = Money::cents(current) + price;
+        if (after > limit)
+            return false;
+
+    } while (!balance.compare_exchange_weak(current, after.getCents(),
+                                            memory_order_acq_rel, memory_order_relaxed));
+    return true;
+
+}
+
+void AtomicCreditCard::makePayment(Money payment)
+{
+    int64_t current = balance.load(memory_order_relaxed);
+
+    // a CAS loop rather than fetch_sub, so that an overflow throws instead of wrapping
+    while (!balance.compare_exchange_weak(current, (Money::cents(current) - payment).getCents(),
+                                          memory_order_acq_rel, memory_order_relaxed))
+    {
+    }
+
+}
+
+ostream& operator << (ostream& out, const AtomicCreditCard& c)
+{
+    out << "Number  = "    << c.getNumber() << endl;
+    out << "Name    = "    << c.getName() << endl;
+    out << "Balance = "    << c.getBalance() << endl;
+    out << "Limit   = "    << c.getLimit() << endl;
+
+
+    return out;
+}
@@ -0,0 +1,47 @@
+/**
+ * This is the header file AtomicCreditCard.h, which contains the definition of class AtomicCreditCard
+ *
+ * AtomicCreditCard can be shared by many threads. The balance is kept in cents in a
+ * std::atomic<int64_t>, and chargelt() does the limit check and the update as a single
+ * compare-and-swap, so no mutex is needed on the authorization path.
+ */
+
+#ifndef ATOMIC_CREDIT_CARD_H
+#define ATOMIC_CREDIT_CARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+#include "Money.h"
+
+class AtomicCreditCard
+{
+    public:
+        // define your constructor
+        AtomicCreditCard(const std::string& no, const std::string& nm, Money lim, Money bal = Money());
+
+                std::string    getNumber()    const { return number ;}
+                std::string    getName()      const { return name   ;}
+                Money          getBalance()   const { return Money::cents(balance.load(std::memory_order_acquire));}
+                Money          getLimit()     const { return limit  ;}
+
+                bool chargelt( Money price);
+                void makePayment(Money payment);
+
+    private:
+
+        std::string     number;
+        std::string     name;
+        Money           limit;      // never changes
+
+        // on its own cache line, so that threads hammering one card do not also
+        // invalidate the read-only fields above
+        alignas(64) std::atomic<std::int64_t> balance;
+
+};
+
+std::ostream& operator << (std::ostream& out, const AtomicCreditCard& c);
+
+#endif
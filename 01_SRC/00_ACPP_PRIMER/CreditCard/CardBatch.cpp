@@ -0,0 +1,303 @@
+
+/**
+ * The file CardBatch.cpp, which contains the batched (bulk) charge and payment functions
+ * of class CardLedger. The limit check and the masked balance update are done on 64-bit
+ * cents with AVX2, or SSE4.2, whichever the CPU has: the kernels are compiled with target
+ * attributes, so no -m flags are needed, and the widest one is picked on the first call.
+ * A scalar loop handles the tails, CPUs without either, and chargeBatch() on ledgers small
+ * enough to stay in cache.
+ *
+ * A batch gives exactly the same result as calling chargelt() once per entry, in order,
+ * including the std::overflow_error thrown by Money: a vector group in which any lane
+ * overflows is redone with the scalar step. With a journal attached every entry goes
+ * through chargelt() or makePayment(), so each one is journaled as soon as it is applied,
+ * and an exception partway through a batch leaves no applied entry out of the journal.
+ */
+
+#include "CardLedger.h"
+#include "CardJournal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CARD_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// scalar reference step, shared by the tails of all kernels
+static inline bool chargeOne(int64_t& balance, int64_t limit, Money price)
+{
+    Money after = price + Money::cents(balance);
+    if (after > Money::cents(limit))
+        return false;
+
+    balance = after.getCents();
+    return true;
+}
+
+// the scalar step for lanes [i, i + width), recording declined charges in rejected
+static inline size_t chargeGroup(int64_t* bal, const int64_t* lim, const CardLedger::Slot* slots,
+                                 const Money* prices, size_t i, size_t width, uint64_t* rejected)
+{
+    size_t accepted = 0;
+    for (size_t k = i; k < i + width; k++)
+    {
+        bool ok = chargeOne(bal[slots[k]], lim[slots[k]], prices[k]);
+        accepted += ok;
+        if (!ok)
+            rejected[k / 64] |= uint64_t(1) << (k % 64);
+    }
+    return accepted;
+}
+
+static size_t chargeEachScalar(int64_t* bal, const int64_t* lim, const Money* prices, size_t n)
+{
+    size_t accepted = 0;
+    for (size_t i = 0; i < n; i++)
+        accepted += chargeOne(bal[i], lim[i], prices[i]);
+    return accepted;
+}
+
+static size_t chargeBatchScalar(int64_t* bal, const int64_t* lim, const CardLedger::Slot* slots,
+                                const Money* prices, size_t count, uint64_t* rejected)
+{
+    return chargeGroup(bal, lim, slots, prices, 0, count, rejected);
+}
+
+#if defined(CARD_BATCH_X86)
+__attribute__((target("sse4.2"))) static size_t chargeEachSse42(int64_t* bal, const int64_t* lim,
+                                                                const Money* prices, size_t n)
+{
+    size_t accepted = 0;
+    size_t i        = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i b   = _mm_loadu_si128((const __m128i*)(bal + i));
+        __m128i p   = _mm_loadu_si128((const __m128i*)(prices + i));
+        __m128i l   = _mm_loadu_si128((const __m128i*)(lim + i));
+        __m128i sum = _mm_add_epi64(b, p);
+
+        // signed overflow happened where the sum has a sign different from both inputs
+        __m128i ovf = _mm_and_si128(_mm_xor_si128(b, sum), _mm_xor_si128(p, sum));
+        if (_mm_movemask_pd(_mm_castsi128_pd(ovf)))
+        {
+            for (size_t k = i; k < i + 2; k++)
+                accepted += chargeOne(bal[k], lim[k], prices[k]);
+            continue;
+        }
+
+        __m128i bad = _mm_cmpgt_epi64(sum, l);
+        _mm_storeu_si128((__m128i*)(bal + i), _mm_blendv_epi8(sum, b, bad));
+        accepted += 2 - __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(bad)));
+    }
+    return accepted + chargeEachScalar(bal + i, lim + i, prices + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t chargeEachAvx2(int64_t* bal, const int64_t* lim,
+                                                             const Money* prices, size_t n)
+{
+    size_t accepted = 0;
+    size_t i        = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i b   = _mm256_loadu_si256((const __m256i*)(bal + i));
+        __m256i p   = _mm256_loadu_si256((const __m256i*)(prices + i));
+        __m256i l   = _mm256_loadu_si256((const __m256i*)(lim + i));
+        __m256i sum = _mm256_add_epi64(b, p);
+
+        __m256i ovf = _mm256_and_si256(_mm256_xor_si256(b, sum), _mm256_xor_si256(p, sum));
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf)))
+        {
+            for (size_t k = i; k < i + 4; k++)
+                accepted += chargeOne(bal[k], lim[k], prices[k]);
+            continue;
+        }
+
+        __m256i bad = _mm256_cmpgt_epi64(sum, l);
+        _mm256_storeu_si256((__m256i*)(bal + i), _mm256_blendv_epi8(sum, b, bad));
+        accepted += 4 - __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(bad)));
+    }
+    return accepted + chargeEachScalar(bal + i, lim + i, prices + i, n - i);
+}
+
+__attribute__((target("sse4.2"))) static size_t chargeBatchSse42(int64_t* bal, const int64_t* lim,
+                                                                 const CardLedger::Slot* slots, const Money* prices,
+                                                                 size_t count, uint64_t* rejected)
+{
+    size_t accepted = 0;
+    size_t i        = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const CardLedger::Slot* s = slots + i;
+        if (s[0] == s[1])
+        {
+            accepted += chargeGroup(bal, lim, slots, prices, i, 2, rejected);
+            continue;
+        }
+
+        __m128i b   = _mm_set_epi64x(bal[s[1]], bal[s[0]]);
+        __m128i l   = _mm_set_epi64x(lim[s[1]], lim[s[0]]);
+        __m128i p   = _mm_loadu_si128((const __m128i*)(prices + i));
+        __m128i sum = _mm_add_epi64(b, p);
+
+        __m128i ovf = _mm_and_si128(_mm_xor_si128(b, sum), _mm_xor_si128(p, sum));
+        if (_mm_movemask_pd(_mm_castsi128_pd(ovf)))
+        {
+            accepted += chargeGroup(bal, lim, slots, prices, i, 2, rejected);
+            continue;
+        }
+
+        __m128i bad = _mm_cmpgt_epi64(sum, l);
+
+        alignas(16) int64_t out[2];
+        _mm_store_si128((__m128i*)out, _mm_blendv_epi8(sum, b, bad));
+        bal[s[0]] = out[0];
+        bal[s[1]] = out[1];
+
+        unsigned mask = unsigned(_mm_movemask_pd(_mm_castsi128_pd(bad)));
+        accepted += 2 - __builtin_popcount(mask);
+        rejected[i / 64] |= uint64_t(mask) << (i % 64);
+    }
+    return accepted + chargeGroup(bal, lim, slots, prices, i, count - i, rejected);
+}
+
+__attribute__((target("avx2"))) static size_t chargeBatchAvx2(int64_t* bal, const int64_t* lim,
+                                                              const CardLedger::Slot* slots, const Money* prices,
+                                                              size_t count, uint64_t* rejected)
+{
+    size_t accepted = 0;
+    size_t i        = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const CardLedger::Slot* s = slots + i;
+        // two charges on the same card inside one vector must see each other, so such
+        // groups go through the scalar step to keep the sequential semantics
+        if (s[0] == s[1] || s[0] == s[2] || s[0] == s[3] ||
+            s[1] == s[2] || s[1] == s[3] || s[2] == s[3])
+        {
+            accepted += chargeGroup(bal, lim, slots, prices, i, 4, rejected);
+            continue;
+        }
+
+        __m256i idx = _mm256_loadu_si256((const __m256i*)s);
+        __m256i b   = _mm256_i64gather_epi64((const long long*)bal, idx, 8);
+        __m256i l   = _mm256_i64gather_epi64((const long long*)lim, idx, 8);
+        __m256i p   = _mm256_loadu_si256((const __m256i*)(prices + i));
+        __m256i sum = _mm256_add_epi64(b, p);
+
+        __m256i ovf = _mm256_and_si256(_mm256_xor_si256(b, sum), _mm256_xor_si256(p, sum));
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf)))
+        {
+            accepted += chargeGroup(bal, lim, slots, prices, i, 4, rejected);
+            continue;
+        }
+
+        __m256i bad = _mm256_cmpgt_epi64(sum, l);
+
+        // AVX2 has no scatter, the updated lanes are written back one by one
+        alignas(32) int64_t out[4];
+        _mm256_store_si256((__m256i*)out, _mm256_blendv_epi8(sum, b, bad));
+        bal[s[0]] = out[0];
+        bal[s[1]] = out[1];
+        bal[s[2]] = out[2];
+        bal[s[3]] = out[3];
+
+        unsigned mask = unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(bad)));
+        accepted += 4 - __builtin_popcount(mask);
+        rejected[i / 64] |= uint64_t(mask) << (i % 64);
+    }
+    return accepted + chargeGroup(bal, lim, slots, prices, i, count - i, rejected);
+}
+#endif
+
+namespace
+{
+    // cards from which chargeBatch() uses the vector kernels: 8 MiB of balances and limits
+    const size_t gatherFrom = size_t(1) << 19;
+
+    struct Kernels
+    {
+        size_t (*each)(int64_t*, const int64_t*, const Money*, size_t);
+        size_t (*batch)(int64_t*, const int64_t*, const CardLedger::Slot*, const Money*, size_t, uint64_t*);
+    };
+
+    // the widest kernels the CPU runs, picked on the first call
+    const Kernels& kernels()
+    {
+        static const Kernels k = []()
+        {
+#if defined(CARD_BATCH_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                Kernels avx2 = { chargeEachAvx2, chargeBatchAvx2 };
+                return avx2;
+            }
+            if (__builtin_cpu_supports("sse4.2"))
+            {
+                Kernels sse42 = { chargeEachSse42, chargeBatchSse42 };
+                return sse42;
+            }
+#endif
+            Kernels scalar = { chargeEachScalar, chargeBatchScalar };
+            return scalar;
+        }();
+        return k;
+    }
+}
+
+size_t CardLedger::chargeEach(const Money* prices)
+{
+    // a journal needs to know which charges went through, so take the per card path
+    if (journal)
+    {
+        size_t accepted = 0;
+        for (Slot s = 0; s < balances.size(); s++)
+            accepted += chargelt(s, prices[s]);
+        return accepted;
+    }
+
+    return kernels().each(balances.data(), limits.data(), prices, balances.size());
+}
+
+size_t CardLedger::chargeBatch(const Slot* slots, const Money* prices, size_t count, uint64_t* rejected)
+{
+    for (size_t w = 0; w < (count + 63) / 64; w++)
+        rejected[w] = 0;
+
+    // every accepted charge is journaled right after it is applied
+    if (journal)
+    {
+        size_t accepted = 0;
+        for (size_t k = 0; k < count; k++)
+        {
+            bool ok = chargelt(slots[k], prices[k]);
+            accepted += ok;
+            if (!ok)
+                rejected[k / 64] |= uint64_t(1) << (k % 64);
+        }
+        return accepted;
+    }
+
+    // the vector kernels gather and write back lane by lane, which only pays off once the
+    // columns are far out of cache and the gathers overlap their misses; below that the
+    // scalar loop is about twice as fast
+    if (balances.size() < gatherFrom)
+        return chargeBatchScalar(balances.data(), limits.data(), slots, prices, count, rejected);
+    return kernels().batch(balances.data(), limits.data(), slots, prices, count, rejected);
+}
+
+void CardLedger::paymentBatch(const Slot* slots, const Money* payments, size_t count)
+{
+    // payments are never declined, so there is no mask and nothing to check
+    if (journal)
+    {
+        for (size_t i = 0; i < count; i++)
+            makePayment(slots[i], payments[i]);
+        return;
+    }
+
+    int64_t* bal = balances.data();
+    for (size_t i = 0; i < count; i++)
+        bal[slots[i]] = (Money::cents(bal[slots[i]]) - payments[i]).getCents();
+}
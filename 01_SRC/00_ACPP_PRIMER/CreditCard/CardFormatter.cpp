@@ -0,0 +1,106 @@
+
+/**
+ * The file CardFormatter.cpp, which contains the definition of out-of-class member functions
+ * for class CardFormatter and the function dumpWallet
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "CardFormatter.h"
+
+using namespace std;
+
+CardFormatter::CardFormatter(size_t capacity) : buf(capacity ? capacity : 1), used(0)
+{
+}
+
+void CardFormatter::text(const CardLedger& ledger, CardLedger::Slot s)
+{
+    string_view number = ledger.getNumber(s);
+    string_view name   = ledger.getName(s);
+
+    // the longest possible card, so the buffer is checked once
+    char* p = reserve(4 * 11 + number.size() + name.size() + 2 * Money::maxChars);
+
+    memcpy(p, "Number  = ", 10);            p += 10;
+    memcpy(p, number.data(), number.size());  p += number.size();
+    *p++ = '\n';
+    memcpy(p, "Name    = ", 10);            p += 10;
+    memcpy(p, name.data(), name.size());    p += name.size();
+    *p++ = '\n';
+    memcpy(p, "Balance = ", 10);            p += 10;
+    p = ledger.getBalance(s).toChars(p);
+    *p++ = '\n';
+    memcpy(p, "Limit   = ", 10);            p += 10;
+    p = ledger.getLimit(s).toChars(p);
+    *p++ = '\n';
+
+    used = size_t(p - buf.data());
+}
+
+void CardFormatter::binary(const CardLedger& ledger, CardLedger::Slot s)
+{
+    string_view name    = ledger.getName(s);
+    uint64_t    number  = ledger.getCardNumber(s).getPacked();
+    int64_t     balance = ledger.getBalance(s).getCents();
+    int64_t     limit   = ledger.getLimit(s).getCents();
+    uint16_t    length  = uint16_t(name.size() < 0xFFFF ? name.size() : 0xFFFF);
+
+    reserve(3 * 8 + 2 + length);
+    put(&number,  sizeof number);
+    put(&balance, sizeof balance);
+    put(&limit,   sizeof limit);
+    put(&length,  sizeof length);
+    put(name.data(), length);
+}
+
+void CardFormatter::append(const CardLedger& ledger, CardLedger::Slot s, Format f)
+{
+    if (f == Binary)
+        binary(ledger, s);
+    else
+        text(ledger, s);
+}
+
+void CardFormatter::writeTo(ostream& out)
+{
+    out.write(buf.data(), streamsize(used));
+    used = 0;
+}
+
+char* CardFormatter::reserve(size_t bytes)
+{
+    // grows only for a card larger than everything seen so far
+    if (used + bytes > buf.size())
+        buf.resize(max(2 * buf.size(), used + bytes));
+    return buf.data() + used;
+}
+
+void CardFormatter::put(const void* p, size_t bytes)
+{
+    memcpy(buf.data() + used, p, bytes);
+    used += bytes;
+}
+
+size_t dumpWallet(const CardLedger& ledger, ostream& out, CardFormatter::Format f)
+{
+    const size_t chunk = 1 << 20;
+
+    // small wallets should not pay for zeroing a whole chunk
+    CardFormatter formatter(min(chunk, 64 * ledger.size()) + 4096);
+    size_t        total = 0;
+    for (CardLedger::Slot s = 0; s < ledger.size(); s++)
+    {
+        formatter.append(ledger, s, f);
+        if (formatter.size() >= chunk)
+        {
+            total += formatter.size();
+            formatter.writeTo(out);
+        }
+    }
+    total += formatter.size();
+    formatter.writeTo(out);
+    return total;
+}
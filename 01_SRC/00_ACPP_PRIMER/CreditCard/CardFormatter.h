@@ -0,0 +1,60 @@
+/**
+ * This is the header file CardFormatter.h, which contains the definition of class CardFormatter
+ *
+ * A CardFormatter renders cards of a CardLedger into one reusable byte buffer, either as the
+ * same text that operator << prints or as a compact binary record:
+ *
+ *      uint64_t    packed CardNumber
+ *      int64_t     balance in cents
+ *      int64_t     limit in cents
+ *      uint16_t    name length, followed by the name bytes
+ *
+ * (native byte order, no padding). Nothing is allocated per card and nothing is flushed
+ * per line; dumpWallet() writes the buffer out in large chunks.
+ */
+
+#ifndef CARD_FORMATTER_H
+#define CARD_FORMATTER_H
+
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "CardLedger.h"
+
+class CardFormatter
+{
+    public:
+        enum Format { Text, Binary };
+
+        explicit CardFormatter(std::size_t capacity = 1 << 20);
+
+                void text(const CardLedger& ledger, CardLedger::Slot s);
+                void binary(const CardLedger& ledger, CardLedger::Slot s);
+                void append(const CardLedger& ledger, CardLedger::Slot s, Format f);
+
+                const char*     data()  const { return buf.data()   ;}
+                std::size_t     size()  const { return used         ;}
+                std::string_view view() const { return std::string_view(buf.data(), used);}
+
+                // empties the buffer, keeping its memory
+                void clear() { used = 0 ;}
+                // writes the buffer to out and empties it
+                void writeTo(std::ostream& out);
+
+    private:
+
+        char* reserve(std::size_t bytes);
+        void  put(const void* p, std::size_t bytes);
+
+        std::vector<char>   buf;
+        std::size_t         used;
+
+};
+
+// writes every card of ledger to out, returns the number of bytes written
+std::size_t dumpWallet(const CardLedger& ledger, std::ostream& out,
+                       CardFormatter::Format f = CardFormatter::Text);
+
+#endif
@@ -0,0 +1,307 @@
+
+/**
+ * The file CardJournal.cpp, which contains the definition of out-of-class member functions
+ * for class CardJournal
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CardJournal.h"
+#include "CreditCard.h"
+
+using namespace std;
+
+namespace
+{
+    const char      journalMagic[8]  = { 'C', 'C', 'J', 'R', 'N', 'L', '1', 0 };
+    const uint64_t  initialRecords   = 1 << 16;
+
+    // the first record sized block of the file
+    struct Header
+    {
+        char        magic[8];
+        uint64_t    count;          // committed records
+        uint64_t    reserved[2];
+    };
+
+    static_assert(sizeof(Header) == sizeof(CardJournal::Record), "header must fill one record");
+    static_assert(sizeof(CardJournal::Record) == 32, "records are 32 bytes");
+
+    void fail(const char* what)
+    {
+        throw runtime_error(string("CardJournal: ") + what + ": " + strerror(errno));
+    }
+
+    // a read-only mapping of a whole file, unmapped however replay() leaves
+    struct Mapping
+    {
+        void*   at;
+        size_t  bytes;
+
+        ~Mapping()
+        {
+            if (at != MAP_FAILED)
+                munmap(at, bytes);
+        }
+    };
+
+    uint64_t textRecords(size_t bytes)
+    {
+        return (bytes + sizeof(CardJournal::Record) - 1) / sizeof(CardJournal::Record);
+    }
+}
+
+CardJournal::CardJournal(const string& path, size_t groupSize)
+    : fd(-1), base(0), capacity(0), count(0), synced(0), opened(0), groupSize(groupSize ? groupSize : 1)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        fail("open");
+
+    // the destructor does not run for a constructor that throws, so undo the open here
+    try
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            fail("fstat");
+
+        uint64_t existing = uint64_t(st.st_size) / sizeof(Record);
+        map(existing > 1 ? existing - 1 : initialRecords);
+
+        Header* h = (Header*)base;
+        if (existing == 0)
+        {
+            memcpy(h->magic, journalMagic, sizeof journalMagic);
+            h->count = 0;
+        }
+        else if (memcmp(h->magic, journalMagic, sizeof journalMagic) != 0)
+            throw runtime_error("CardJournal: " + path + " is not a card journal");
+
+        // anything after the committed count was never made durable and is overwritten; a count
+        // past the end of a truncated file only goes as far as the records that are there
+        uint64_t present = existing > 1 ? existing - 1 : 0;
+        count  = min<uint64_t>(h->count, present);
+        synced = count;
+
+        // the ordinal of the next card is the number of cards opened in the committed records
+        const Record* r = (const Record*)base + 1;
+        for (uint64_t i = 0; i < count; i++)
+            if (r[i].type == Open)
+            {
+                opened++;
+                i += textRecords(size_t(r[i].numberLength) + r[i].nameLength);
+            }
+    }
+    catch (...)
+    {
+        unmap();
+        ::close(fd);
+        throw;
+    }
+}
+
+CardJournal::~CardJournal()
+{
+    try
+    {
+        commitLocked();
+    }
+    catch (...)
+    {
+    }
+    unmap();
+    ::close(fd);
+}
+
+void CardJournal::logOpen(string_view no, string_view nm, Money lim, Money bal)
+{
+    lock_guard<mutex> lock(guard);
+    Record* r       = append();
+    r->type         = Open;
+    r->numberLength = uint16_t(no.size());
+    r->nameLength   = uint32_t(nm.size());
+    r->card         = opened++;
+    r->amount       = lim.getCents();
+    r->balance      = bal.getCents();
+
+    string text = string(no).append(nm);
+    for (uint64_t k = 0; k < textRecords(text.size()); k++)
+    {
+        Record* t   = append();
+        size_t  off = size_t(k) * sizeof(Record);
+        memset(t, 0, sizeof(Record));
+        memcpy(t, text.data() + off, min(sizeof(Record), text.size() - off));
+    }
+    written();
+}
+
+void CardJournal::logCharge(uint64_t card, Money price)
+{
+    lock_guard<mutex> lock(guard);
+    Record* r       = append();
+    r->type         = Charge;
+    r->numberLength = 0;
+    r->nameLength   = 0;
+    r->card         = card;
+    r->amount       = price.getCents();
+    r->balance      = 0;
+    written();
+}
+
+void CardJournal::logPayment(uint64_t card, Money payment)
+{
+    lock_guard<mutex> lock(guard);
+    Record* r       = append();
+    r->type         = Payment;
+    r->numberLength = 0;
+    r->nameLength   = 0;
+    r->card         = card;
+    r->amount       = payment.getCents();
+    r->balance      = 0;
+    written();
+}
+
+void CardJournal::commit()
+{
+    lock_guard<mutex> lock(guard);
+    commitLocked();
+}
+
+void CardJournal::commitLocked()
+{
+    if (synced == count)
+        return;
+
+    // the records first, then the count that makes them visible to replay()
+    long     page  = sysconf(_SC_PAGESIZE);
+    uint64_t from  = (1 + synced) * sizeof(Record) / page * page;
+    uint64_t to    = (1 + count)  * sizeof(Record);
+    if (msync(base + from, to - from, MS_SYNC) != 0)
+        fail("msync");
+
+    ((Header*)base)->count = count;
+    if (msync(base, sizeof(Header), MS_SYNC) != 0)
+        fail("msync");
+
+    synced = count;
+}
+
+vector<CreditCard> CardJournal::replay(const string& path, CardLedger& ledger)
+{
+    vector<CreditCard> wallet;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return wallet;      // no journal yet, nothing to replay
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(Header)))
+    {
+        ::close(fd);
+        return wallet;
+    }
+
+    Mapping file = { mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0), size_t(st.st_size) };
+    ::close(fd);
+    if (file.at == MAP_FAILED)
+        fail("mmap");
+    madvise(file.at, file.bytes, MADV_SEQUENTIAL);
+
+    const void*      m      = file.at;
+    const Header*    h      = (const Header*)m;
+    const Record*    r      = (const Record*)m + 1;
+    // the records the file really holds, whatever a damaged header says
+    uint64_t         n      = min<uint64_t>(h->count, uint64_t(st.st_size) / sizeof(Record) - 1);
+    CardLedger::Slot first  = ledger.size();
+    if (memcmp(h->magic, journalMagic, sizeof journalMagic) != 0)
+        throw runtime_error("CardJournal: " + path + " is not a card journal");
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        switch (r[i].type)
+        {
+            case Open:
+            {
+                // the text records must be committed records too
+                if (textRecords(size_t(r[i].numberLength) + r[i].nameLength) > n - i - 1)
+                    throw runtime_error("CardJournal: " + path + " has a card whose text runs past its last record");
+
+                // cards are opened in the order of their ordinals, the n-th one is first + n
+                if (r[i].card != ledger.size() - first)
+                    throw runtime_error("CardJournal: " + path + " opens its cards out of order");
+
+                // ledger.add() and chargelt() below may throw too, file unmaps the journal then
+                const char* text = (const char*)(r + i + 1);
+                string_view no(text, r[i].numberLength);
+                string_view nm(text + r[i].numberLength, r[i].nameLength);
+                CardLedger::Slot s = ledger.add(no, nm, Money::cents(r[i].amount), Money::cents(r[i].balance));
+                wallet.push_back(ledger.card(s));
+                i += textRecords(no.size() + nm.size());
+                break;
+            }
+            // only accepted charges are journaled, so replaying them is always accepted again
+            case Charge:
+            case Payment:
+                if (r[i].card >= ledger.size() - first)
+                    throw runtime_error("CardJournal: " + path + " uses a card it never opened");
+                if (r[i].type == Charge)
+                    ledger.chargelt(first + r[i].card, Money::cents(r[i].amount));
+                else
+                    ledger.makePayment(first + r[i].card, Money::cents(r[i].amount));
+                break;
+            default:
+                break;
+        }
+    }
+
+    return wallet;
+}
+
+CardJournal::Record* CardJournal::append()
+{
+    // no commit here: the pages written through the old mapping stay in the file, and
+    // committing now could publish an Open record without its text records
+    if (count == capacity)
+    {
+        unmap();
+        map(capacity * 2);
+    }
+
+    return (Record*)base + 1 + count++;
+}
+
+void CardJournal::written()
+{
+    // group commit: one pair of syncs for every groupSize records
+    if (count - synced >= groupSize)
+        commitLocked();
+}
+
+void CardJournal::map(uint64_t records)
+{
+    size_t bytes = size_t(records + 1) * sizeof(Record);
+    if (ftruncate(fd, off_t(bytes)) != 0)
+        fail("ftruncate");
+
+    void* m = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+        fail("mmap");
+
+    base     = (char*)m;
+    capacity = records;
+}
+
+void CardJournal::unmap()
+{
+    if (base)
+        munmap(base, size_t(capacity + 1) * sizeof(Record));
+    base = 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * This is the header file CardJournal.h, which contains the definition of class CardJournal
+ *
+ * A CardJournal is an append-only binary file of fixed 32-byte records, one per opened card,
+ * accepted charge and payment. The file is memory-mapped, so appending is a plain store, and
+ * records are made durable in groups: commit() (called every groupSize records and on close)
+ * syncs the new records first and then the record count in the header. After a crash
+ * replay() only trusts committed records. The log functions may be called from several
+ * threads; they serialize on an internal mutex.
+ *
+ * Records name their card by its ordinal in the journal (the n-th card it opened), not by
+ * its ledger slot, so a journal replays into a ledger that already holds other cards. Attach
+ * a journal with CardLedger::attach() after replaying it, so the replay is not written to
+ * the journal a second time.
+ */
+
+#ifndef CARD_JOURNAL_H
+#define CARD_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CardLedger.h"
+#include "Money.h"
+
+class CreditCard;
+
+class CardJournal
+{
+    public:
+        enum RecordType { Open = 1, Charge = 2, Payment = 3 };
+
+        // every record is 32 bytes; an Open record is followed by the card number and name
+        // packed into as many raw 32-byte records as they need
+        struct Record
+        {
+            std::uint16_t   type;
+            std::uint16_t   numberLength;   // Open only
+            std::uint32_t   nameLength;     // Open only
+            std::uint64_t   card;           // ordinal of the card in the journal
+            std::int64_t    amount;         // cents; the limit for Open
+            std::int64_t    balance;        // cents; the opening balance for Open
+        };
+
+        // opens or creates the journal and appends after its last committed record
+        explicit CardJournal(const std::string& path, std::size_t groupSize = 4096);
+        ~CardJournal();
+
+                // logOpen gives the card the next ordinal, the others take that ordinal
+                void logOpen(std::string_view no, std::string_view nm, Money lim, Money bal);
+                void logCharge(std::uint64_t card, Money price);
+                void logPayment(std::uint64_t card, Money payment);
+
+                void            commit();
+                std::uint64_t   size()      const { return count    ;}
+                std::uint64_t   committed() const { return synced   ;}
+                std::uint64_t   cards()     const { return opened   ;}
+
+        // appends the cards of the journal to ledger in one sequential pass over the file
+        // and returns them; a missing file is an empty journal
+        static std::vector<CreditCard> replay(const std::string& path, CardLedger& ledger);
+
+    private:
+
+        CardJournal(const CardJournal&);
+        CardJournal& operator = (const CardJournal&);
+
+        Record* append();
+        void    written();
+        void    commitLocked();
+        void    map(std::uint64_t records);
+        void    unmap();
+
+        int             fd;
+        char*           base;
+        std::uint64_t   capacity;       // records that fit in the mapping
+        std::uint64_t   count;          // records written
+        std::uint64_t   synced;         // records committed to disk
+        std::uint64_t   opened;         // cards opened, committed or not
+        std::size_t     groupSize;
+        std::mutex      guard;
+
+};
+
+#endif
@@ -0,0 +1,187 @@
+
+/**
+ * The file CardLedger.cpp, which contains the definition of out-of-class member functions
+ * for class CardLedger
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "CardLedger.h"
+#include "CreditCard.h"
+#include "CardJournal.h"
+
+using namespace std;
+
+namespace
+{
+    // Fibonacci hashing, the packed numbers are far from uniform in their low bits
+    inline size_t hashNumber(CardNumber n, size_t mask)
+    {
+        return size_t((n.getPacked() * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+}
+
+CardLedger::Slot CardLedger::add(string_view no, string_view nm, Money lim, Money bal)
+{
+    CardNumber number;
+    if (!CardNumber::parse(no, number))
+        throw invalid_argument("CardLedger: not a card number: " + string(no));
+
+    numbers.push_back(number);
+    numberText.push_back(text.copy(no));
+    names.push_back(intern(nm));
+    limits.push_back(lim.getCents());
+    balances.push_back(bal.getCents());
+
+    if (journal)
+        journal->logOpen(no, nm, lim, bal);
+    return balances.size() - 1;
+}
+
+void CardLedger::reserve(size_t n)
+{
+    numbers.reserve(n);
+    numberText.reserve(n);
+    names.reserve(n);
+    limits.reserve(n);
+    balances.reserve(n);
+}
+
+void CardLedger::clear()
+{
+    numbers.clear();
+    numberText.clear();
+    names.clear();
+    limits.clear();
+    balances.clear();
+    strings.clear();
+    stringTable.assign(stringTable.size(), 0);
+    numberIndex.assign(numberIndex.size(), 0);
+    indexed = 0;
+    text.reset();
+}
+
+bool CardLedger::chargelt(Slot s, Money price)
+{
+    Money after = price + getBalance(s);
+    if (after > getLimit(s))
+        return false;
+
+    balances[s] = after.getCents();
+    if (journal && s >= journalFirst)
+        journal->logCharge(s - journalFirst, price);
+
+    return true;
+
+}
+
+void CardLedger::makePayment(Slot s, Money payment)
+{
+    balances[s] = (getBalance(s) - payment).getCents();
+    if (journal && s >= journalFirst)
+        journal->logPayment(s - journalFirst, payment);
+
+}
+
+void CardLedger::attach(CardJournal* j)
+{
+    if (j && j->cards() > balances.size())
+        throw invalid_argument("CardLedger: the journal has more cards than the ledger");
+
+    // the journal names cards by ordinal, the n-th card of the journal is in journalFirst + n
+    journal      = j;
+    journalFirst = j ? balances.size() - j->cards() : 0;
+}
+
+CardLedger::Slot CardLedger::find(CardNumber number) const
+{
+    if (indexed < balances.size())
+        indexAdded();
+    if (numberIndex.empty())
+        return npos;
+
+    size_t mask = numberIndex.size() - 1;
+    for (size_t h = hashNumber(number, mask); numberIndex[h]; h = (h + 1) & mask)
+        if (numbers[numberIndex[h] - 1] == number)
+            return numberIndex[h] - 1;
+    return npos;
+}
+
+CardLedger::Slot CardLedger::find(string_view number) const
+{
+    CardNumber n;
+    return CardNumber::parse(number, n) ? find(n) : npos;
+}
+
+CreditCard CardLedger::card(Slot s)
+{
+    return CreditCard(*this, s);
+}
+
+CardLedger& CardLedger::shared()
+{
+    static CardLedger ledger;
+    return ledger;
+}
+
+void CardLedger::indexAdded() const
+{
+    // same scheme as the string table: at most half full, and when it has to grow, sized
+    // once for all the cards added since and rebuilt
+    size_t want = max<size_t>(64, numberIndex.size());
+    while (2 * balances.size() > want)
+        want *= 2;
+    if (want != numberIndex.size())
+    {
+        numberIndex.assign(want, 0);
+        indexed = 0;
+    }
+
+    size_t mask = numberIndex.size() - 1;
+    for (; indexed < balances.size(); indexed++)
+    {
+        size_t h = hashNumber(numbers[indexed], mask);
+        while (numberIndex[h] && numbers[numberIndex[h] - 1] != numbers[indexed])
+            h = (h + 1) & mask;
+        // a duplicate number stays reachable through its first slot only
+        if (!numberIndex[h])
+            numberIndex[h] = indexed + 1;
+    }
+}
+
+uint32_t CardLedger::intern(string_view s)
+{
+    // cards are mostly loaded a customer at a time
+    if (lastString < strings.size() && strings[lastString] == s)
+        return lastString;
+
+    // keep the table at most half full, rehashing the ids we already have
+    if (2 * (strings.size() + 1) > stringTable.size())
+    {
+        vector<uint32_t> old(max<size_t>(64, 2 * stringTable.size()), 0);
+        old.swap(stringTable);
+        size_t mask = stringTable.size() - 1;
+        for (uint32_t id = 0; id < strings.size(); id++)
+        {
+            size_t h = hash<string_view>()(strings[id]) & mask;
+            while (stringTable[h])
+                h = (h + 1) & mask;
+            stringTable[h] = id + 1;
+        }
+    }
+
+    size_t mask = stringTable.size() - 1;
+    size_t h    = hash<string_view>()(s) & mask;
+    while (stringTable[h])
+    {
+        if (strings[stringTable[h] - 1] == s)
+            return lastString = stringTable[h] - 1;
+        h = (h + 1) & mask;
+    }
+
+    uint32_t id = uint32_t(strings.size());
+    strings.push_back(text.copy(s));
+    stringTable[h] = id + 1;
+    return lastString = id;
+}
@@ -0,0 +1,112 @@
+/**
+ * This is the header file CardLedger.h, which contains the definition of class CardLedger.
+ * A CardLedger keeps the state of many credit cards as parallel columns (struct of arrays),
+ * so that loops over balances and limits walk through contiguous memory. Names are interned
+ * once in a string table and every slot only stores their ids; a name equal to the one of the
+ * card added before is reused without hashing. Card numbers are parsed into a packed
+ * CardNumber column, and their text is kept only for printing. The open addressing index
+ * from number to slot is brought up to date by the first find() after cards were added, not
+ * by add(), so loading cards does no hashing into it. Amounts are stored as raw cents and
+ * handed out as Money.
+ *
+ * All string bytes live in a CardPool, and the intern table is an open addressing array
+ * of ids, so adding a card does not allocate anything per card once the columns are
+ * reserved. The accessors return string_views into the pool and never copy.
+ */
+
+#ifndef CARD_LEDGER_H
+#define CARD_LEDGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CardNumber.h"
+#include "CardPool.h"
+#include "Money.h"
+
+class CreditCard;
+class CardJournal;
+
+class CardLedger
+{
+    public:
+        typedef std::size_t Slot;
+
+        static constexpr Slot npos = Slot(-1);
+
+        CardLedger() : lastString(0), indexed(0), journal(0), journalFirst(0) {}
+
+        // append a new card and return its slot; throws std::invalid_argument when no
+        // is not a card number (see CardNumber::parse)
+        Slot add(std::string_view no, std::string_view nm, Money lim, Money bal = Money());
+        void reserve(std::size_t n);
+        // drops every card and string at once, keeping the allocated memory
+        void clear();
+
+                std::size_t          size()               const { return balances.size()     ;}
+                std::string_view     getNumber(Slot s)    const { return numberText[s]       ;}
+                CardNumber           getCardNumber(Slot s) const { return numbers[s]         ;}
+                std::string_view     getName(Slot s)      const { return strings[names[s]]   ;}
+
+                // the first slot holding number, or npos; O(1) and allocation free once the
+                // cards added since the last call are indexed, so, like add(), not to be called
+                // while other threads use the ledger
+                Slot find(CardNumber number)     const;
+                Slot find(std::string_view number) const;
+                Money                getBalance(Slot s)   const { return Money::cents(balances[s]);}
+                Money                getLimit(Slot s)     const { return Money::cents(limits[s])  ;}
+
+                bool chargelt(Slot s, Money price);
+                void makePayment(Slot s, Money payment);
+
+                // batched versions, see CardBatch.cpp. They return the number of accepted charges.
+                // chargeEach charges prices[i] to slot i for every card in the ledger.
+                // chargeBatch charges prices[i] to slots[i] and sets bit i of rejected (which must
+                // hold (count + 63) / 64 words) when that charge was declined.
+                std::size_t chargeEach(const Money* prices);
+                std::size_t chargeBatch(const Slot* slots, const Money* prices, std::size_t count,
+                                        std::uint64_t* rejected);
+                void        paymentBatch(const Slot* slots, const Money* payments, std::size_t count);
+
+                CreditCard card(Slot s);
+
+                // from now on every new card, accepted charge and payment is also appended
+                // to journal; pass 0 to stop journaling. The cards of the journal must be the
+                // last ones of the ledger, as they are right after CardJournal::replay(), and
+                // the cards before them are not journaled. Throws std::invalid_argument when
+                // the journal has more cards than the ledger
+                void attach(CardJournal* j);
+
+        // the ledger used by cards that are constructed without an explicit ledger
+        static CardLedger& shared();
+
+    private:
+
+        std::uint32_t intern(std::string_view s);
+        void          indexAdded() const;
+
+        std::vector<std::int64_t>  balances;     // cents
+        std::vector<std::int64_t>  limits;       // cents
+        std::vector<CardNumber>    numbers;
+        std::vector<std::string_view> numberText;   // views into text
+        std::vector<std::uint32_t> names;
+
+        std::vector<std::string_view>   strings;        // views into text
+        std::vector<std::uint32_t>      stringTable;    // id + 1 of the string hashed there, 0 when empty
+        std::uint32_t                   lastString;     // id of the last string interned
+        CardPool                        text;
+
+        // open addressing, linear probing; slot + 1 of the card hashed there, 0 when empty.
+        // The slots below indexed are in it
+        mutable std::vector<Slot>       numberIndex;
+        mutable Slot                    indexed;
+
+        CardJournal*                    journal;
+        Slot                            journalFirst;   // slot of the first card of journal
+
+};
+
+#endif
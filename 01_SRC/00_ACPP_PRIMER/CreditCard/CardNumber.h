@@ -0,0 +1,77 @@
+/**
+ * This is the header file CardNumber.h, which contains the definition of class CardNumber
+ *
+ * A CardNumber is a card number such as "5391-0375-9387-5309" parsed once into a single
+ * 64-bit word, so that comparing and hashing numbers never touches a string:
+ *
+ *      bits  0..59   the digits as an integer (up to 18 digits fit)
+ *      bits 60..62   number of digits - 12
+ *      bit  63       set when the number passes the Luhn check
+ */
+
+#ifndef CARD_NUMBER_H
+#define CARD_NUMBER_H
+
+#include <cstdint>
+#include <string_view>
+
+class CardNumber
+{
+    public:
+        static constexpr unsigned minDigits = 12;
+        static constexpr unsigned maxDigits = 18;
+
+        constexpr CardNumber() : packed(0) {}
+
+        // digits, optionally grouped with ' ' or '-'; false when text is not a card number
+        static constexpr bool parse(std::string_view text, CardNumber& out)
+        {
+            std::uint64_t digits = 0;
+            unsigned      length = 0;
+            for (char ch : text)
+            {
+                if (ch == ' ' || ch == '-')
+                    continue;
+                if (ch < '0' || ch > '9' || length == maxDigits)
+                    return false;
+                digits = digits * 10 + std::uint64_t(ch - '0');
+                length++;
+            }
+            if (length < minDigits)
+                return false;
+
+            out.packed = digits | std::uint64_t(length - minDigits) << 60
+                                | std::uint64_t(luhn(digits)) << 63;
+            return true;
+        }
+
+        // the Luhn (mod 10) check digit test, run from the rightmost digit
+        static constexpr bool luhn(std::uint64_t digits)
+        {
+            unsigned sum    = 0;
+            bool     doubled = false;
+            for (; digits; digits /= 10, doubled = !doubled)
+            {
+                unsigned d = unsigned(digits % 10);
+                if (doubled)
+                    d = d * 2 > 9 ? d * 2 - 9 : d * 2;
+                sum += d;
+            }
+            return sum % 10 == 0;
+        }
+
+                constexpr std::uint64_t  getPacked()   const { return packed                       ;}
+                constexpr std::uint64_t  getDigits()   const { return packed & ((std::uint64_t(1) << 60) - 1);}
+                constexpr unsigned       getLength()   const { return unsigned(packed >> 60 & 7) + minDigits;}
+                constexpr bool           isValid()     const { return packed >> 63                 ;}
+
+        constexpr bool operator == (CardNumber n) const { return packed == n.packed; }
+        constexpr bool operator != (CardNumber n) const { return packed != n.packed; }
+
+    private:
+
+        std::uint64_t packed;
+
+};
+
+#endif
@@ -0,0 +1,76 @@
+
+/**
+ * The file CardPool.cpp, which contains the definition of out-of-class member functions
+ * for class CardPool
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "CardPool.h"
+
+using namespace std;
+
+CardPool::CardPool(size_t blockSize)
+    : current(0), next(0), end(0), blockSize(blockSize ? blockSize : 1), used(0)
+{
+}
+
+CardPool::~CardPool()
+{
+    for (size_t b = 0; b < blocks.size(); b++)
+        delete [] blocks[b].data;
+}
+
+void* CardPool::allocate(size_t bytes, size_t align)
+{
+    uintptr_t p = (uintptr_t(next) + align - 1) & ~uintptr_t(align - 1);
+    if (!next || p + bytes > uintptr_t(end))
+    {
+        nextBlock(bytes + align);
+        p = (uintptr_t(next) + align - 1) & ~uintptr_t(align - 1);
+    }
+
+    next  = (char*)(p + bytes);
+    used += bytes;
+    return (void*)p;
+}
+
+string_view CardPool::copy(string_view s)
+{
+    char* p = (char*)allocate(s.size(), 1);
+    memcpy(p, s.data(), s.size());
+    return string_view(p, s.size());
+}
+
+void CardPool::reset()
+{
+    current = 0;
+    used    = 0;
+    next    = blocks.empty() ? 0 : blocks[0].data;
+    end     = blocks.empty() ? 0 : blocks[0].data + blocks[0].size;
+}
+
+void CardPool::nextBlock(size_t bytes)
+{
+    // after a reset the old blocks are reused in order, as long as they are big enough
+    while (!blocks.empty() && current + 1 < blocks.size())
+    {
+        current++;
+        if (blocks[current].size >= bytes)
+        {
+            next = blocks[current].data;
+            end  = next + blocks[current].size;
+            return;
+        }
+    }
+
+    Block b;
+    b.size = bytes > blockSize ? bytes : blockSize;
+    b.data = new char[b.size];
+    blocks.push_back(b);
+
+    current = blocks.size() - 1;
+    next    = b.data;
+    end     = b.data + b.size;
+}
@@ -0,0 +1,65 @@
+/**
+ * This is the header file CardPool.h, which contains the definition of class CardPool
+ *
+ * A CardPool is an arena: it hands out memory by bumping a pointer through large blocks and
+ * never frees single objects. reset() forgets everything carved out so far but keeps the
+ * blocks for reuse, so loading and dropping millions of cards costs a handful of heap
+ * allocations instead of several per card. Only trivially destructible objects (such as
+ * CreditCard views) may be created in a pool, since their destructors never run.
+ */
+
+#ifndef CARD_POOL_H
+#define CARD_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class CardPool
+{
+    public:
+        explicit CardPool(std::size_t blockSize = 1 << 20);
+        ~CardPool();
+
+                void*               allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t));
+                std::string_view    copy(std::string_view s);
+
+                template <typename T, typename... Args> T* make(Args&&... args)
+                {
+                    static_assert(std::is_trivially_destructible<T>::value,
+                                  "CardPool never runs destructors");
+                    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+                }
+
+                // everything allocated so far becomes invalid, the blocks are kept
+                void reset();
+
+                std::size_t getBlocks()    const { return blocks.size();}
+                std::size_t getUsed()      const { return used         ;}
+
+    private:
+
+        CardPool(const CardPool&);
+        CardPool& operator = (const CardPool&);
+
+        void nextBlock(std::size_t bytes);
+
+        struct Block
+        {
+            char*           data;
+            std::size_t     size;
+        };
+
+        std::vector<Block>  blocks;
+        std::size_t         current;        // index of the block being carved
+        char*               next;
+        char*               end;
+        std::size_t         blockSize;
+        std::size_t         used;
+
+};
+
+#endif
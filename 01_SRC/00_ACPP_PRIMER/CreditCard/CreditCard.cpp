@@ -8,37 +8,32 @@
 
 using namespace std;
 
-CreditCard::CreditCard(const string& no, const string& nm, int lim, double bal)
+CreditCard::CreditCard(const string& no, const string& nm, Money lim, Money bal)
 {
-    number  = no;
-    name    = nm;
-    balance = bal;
-    limit   = lim;
+    ledger = &CardLedger::shared();
+    slot   = ledger->add(no, nm, lim, bal);
 
 }
 
-bool CreditCard::chargelt(double price)
+bool CreditCard::chargelt(Money price)
 {
-    if (price + balance > double (limit))
-        return false;
-
-    balance += price;
-        return true;
+    return ledger->chargelt(slot, price);
 
 }
 
-void CreditCard::makePayment(double payment)
+void CreditCard::makePayment(Money payment)
 {
-    balance -= payment ;
+    ledger->makePayment(slot, payment);
 
 }
 
+// no std::endl: flushing is left to the caller, see CardFormatter for bulk output
 ostream& operator << (ostream& out, const CreditCard& c)
 {
-    out << "Number  = "    << c.getNumber() << endl;
-    out << "Name    = "    << c.getName() << endl;
-    out << "Balance = "    << c.getBalance() << endl;
-    out << "Limit   = "    << c.getLimit() << endl;
+    out << "Number  = "    << c.getNumber() << '\n';
+    out << "Name    = "    << c.getName() << '\n';
+    out << "Balance = "    << c.getBalance() << '\n';
+    out << "Limit   = "    << c.getLimit() << '\n';
 
 
     return out;
@@ -1,35 +1,42 @@
 /**
  * This is the header file CreditCard.h, which contains the  definition of class CreditCard
  *
+ * A CreditCard is a lightweight view over one slot of a CardLedger; copying a card copies
+ * the view, not the account. Cards built from strings are appended to CardLedger::shared().
+ * The number and name are returned as views into the ledger, without copying.
  */
 
 #ifndef CREDIT_CARD_H
 #define CREDIT_CARD_H
 
 #include <string>
+#include <string_view>
 #include <iostream>
 
+#include "CardLedger.h"
+#include "Money.h"
+
 class CreditCard
 {
     public:
         // define your constructor
-        CreditCard(const std::string& no, const std::string& nm, int lim, double bal = 0);
+        CreditCard(const std::string& no, const std::string& nm, Money lim, Money bal = Money());
+        CreditCard(CardLedger& ledger, CardLedger::Slot slot) : ledger(&ledger), slot(slot) {}
 
-                std::string    getNumber()    const { return number ;}
-                std::string    getName()      const { return name   ;}
-                double         getBalance()   const { return balance;}
-                int            getLimit()     const { return limit  ;}
+                std::string_view   getNumber()      const { return ledger->getNumber(slot)     ;}
+                CardNumber         getCardNumber()  const { return ledger->getCardNumber(slot) ;}
+                std::string_view   getName()        const { return ledger->getName(slot)       ;}
+                Money          getBalance()   const { return ledger->getBalance(slot);}
+                Money          getLimit()     const { return ledger->getLimit(slot)  ;}
 
-                bool chargelt( double price);
-                void makePayment(double payment);
+                bool chargelt( Money price);
+                void makePayment(Money payment);
 
 
     private:
 
-        std::string number;
-        std::string name;
-        int         limit;
-        double      balance;
+        CardLedger*         ledger;
+        CardLedger::Slot    slot;
 
 };
 
@@ -0,0 +1,113 @@
+/**
+ * This is the header file Money.h, which contains the definition of class Money
+ *
+ * Money is a fixed-point amount stored as a 64-bit count of cents. All arithmetic is
+ * constexpr, exact, and checked: an operation that would overflow throws std::overflow_error
+ * instead of wrapping around.
+ */
+
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <charconv>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+class Money
+{
+    public:
+        constexpr Money() : value(0) {}
+
+        static constexpr Money cents(std::int64_t c)   { return Money(c); }
+        static constexpr Money dollars(std::int64_t d)
+        {
+            std::int64_t c = 0;
+            if (__builtin_mul_overflow(d, std::int64_t (100), &c))
+                throw std::overflow_error("Money: dollar amount out of range");
+            return Money(c);
+        }
+        // rounds to the nearest cent, only meant for input and output
+        static Money fromDouble(double amount)
+        {
+            double c = std::round(amount * 100.0);
+            if (!(c >= -9.2e18 && c <= 9.2e18))
+                throw std::overflow_error("Money: amount out of range");
+            return Money(std::int64_t (c));
+        }
+
+                constexpr std::int64_t getCents()  const { return value;}
+                constexpr double       toDouble()  const { return value / 100.0;}
+
+        // longest text toChars() can write: sign, 17 digits, point and 2 decimals
+        static constexpr std::size_t maxChars = 21;
+
+        // writes the amount as dollars with two decimals, e.g. -12.05, and returns the end
+        char* toChars(char* out) const
+        {
+            std::uint64_t u = value < 0 ? 0 - std::uint64_t (value) : std::uint64_t (value);
+            std::uint64_t f = u % 100;
+
+            if (value < 0)
+                *out++ = '-';
+            out    = std::to_chars(out, out + 17, u / 100).ptr;
+            *out++ = '.';
+            *out++ = char ('0' + f / 10);
+            *out++ = char ('0' + f % 10);
+            return out;
+        }
+
+        constexpr Money operator + (Money m) const
+        {
+            std::int64_t r = 0;
+            if (__builtin_add_overflow(value, m.value, &r))
+                throw std::overflow_error("Money: overflow in +");
+            return Money(r);
+        }
+        constexpr Money operator - (Money m) const
+        {
+            std::int64_t r = 0;
+            if (__builtin_sub_overflow(value, m.value, &r))
+                throw std::overflow_error("Money: overflow in -");
+            return Money(r);
+        }
+        constexpr Money operator * (std::int64_t k) const
+        {
+            std::int64_t r = 0;
+            if (__builtin_mul_overflow(value, k, &r))
+                throw std::overflow_error("Money: overflow in *");
+            return Money(r);
+        }
+        constexpr Money operator - () const { return Money() - *this; }
+
+        constexpr Money& operator += (Money m) { return *this = *this + m; }
+        constexpr Money& operator -= (Money m) { return *this = *this - m; }
+
+        constexpr bool operator == (Money m) const { return value == m.value; }
+        constexpr bool operator != (Money m) const { return value != m.value; }
+        constexpr bool operator <  (Money m) const { return value <  m.value; }
+        constexpr bool operator <= (Money m) const { return value <= m.value; }
+        constexpr bool operator >  (Money m) const { return value >  m.value; }
+        constexpr bool operator >= (Money m) const { return value >= m.value; }
+
+    private:
+
+        constexpr explicit Money(std::int64_t c) : value(c) {}
+
+        std::int64_t value;
+
+};
+
+// the batch kernels read arrays of Money as arrays of int64_t
+static_assert(sizeof(Money) == sizeof(std::int64_t), "Money must be a bare int64_t");
+
+// prints as dollars with two decimals, e.g. -12.05
+inline std::ostream& operator << (std::ostream& out, Money m)
+{
+    char buf[Money::maxChars];
+    return out.write(buf, m.toChars(buf) - buf);
+}
+
+#endif
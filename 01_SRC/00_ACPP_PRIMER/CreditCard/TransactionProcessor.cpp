@@ -0,0 +1,187 @@
+
+/**
+ * The file TransactionProcessor.cpp, which contains the definition of out-of-class member
+ * functions for class TransactionProcessor
+ */
+
+#include "TransactionProcessor.h"
+
+using namespace std;
+
+// a few shards per worker, so that there is something left to steal when one
+// worker's shards run dry while another worker is busy
+static const unsigned shardsPerWorker = 4;
+
+TransactionProcessor::TransactionProcessor(CardLedger& ledger, unsigned workers, size_t batchSize)
+    : ledger(ledger), batchSize(batchSize ? batchSize : 1),
+      workerCount(workers ? workers : max(1u, thread::hardware_concurrency())),
+      shards(size_t(workerCount) * shardsPerWorker),
+      queued(0), inFlight(0), events(0), stopping(false), applied(0), declined(0), failed(0), stolen(0)
+{
+    for (unsigned w = 0; w < workerCount; w++)
+        this->workers.emplace_back(&TransactionProcessor::work, this, w);
+}
+
+TransactionProcessor::~TransactionProcessor()
+{
+    flush();
+    {
+        lock_guard<mutex> lock(wake);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (size_t w = 0; w < workers.size(); w++)
+        workers[w].join();
+}
+
+void TransactionProcessor::submit(const Transaction& t)
+{
+    Shard& shard = shards[shardOf(t.slot)];
+    shard.pending.push_back(t);
+    if (shard.pending.size() >= batchSize)
+        push(shard);
+}
+
+void TransactionProcessor::submit(const Transaction* t, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        submit(t[i]);
+}
+
+void TransactionProcessor::flush()
+{
+    for (size_t s = 0; s < shards.size(); s++)
+        if (!shards[s].pending.empty())
+            push(shards[s]);
+
+    unique_lock<mutex> lock(wake);
+    drained.wait(lock, [this]() { return inFlight.load() == 0; });
+}
+
+size_t TransactionProcessor::shardOf(CardLedger::Slot s)
+{
+    // cached per card, so the hot path is a single load
+    while (shardCache.size() <= s)
+    {
+        uint64_t h = ledger.getCardNumber(shardCache.size()).getPacked() * 0x9E3779B97F4A7C15ull;
+        shardCache.push_back(uint32_t((h >> 32) % shards.size()));
+    }
+    return shardCache[s];
+}
+
+void TransactionProcessor::push(Shard& shard)
+{
+    // counted before the batch is visible, so the worker that takes it cannot count it
+    // down first
+    inFlight++;
+    queued++;
+    {
+        lock_guard<mutex> lock(shard.queue);
+        shard.batches.push_back(Batch());
+        shard.batches.back().swap(shard.pending);
+    }
+    shard.pending.reserve(batchSize);
+
+    {
+        // under the lock, so a worker cannot miss the wakeup between its check and its wait
+        lock_guard<mutex> lock(wake);
+        events++;
+    }
+    wakeup.notify_one();
+}
+
+bool TransactionProcessor::runShard(Shard& shard)
+{
+    // a shard whose batch is being applied by someone else is skipped, not waited for
+    unique_lock<mutex> applying(shard.apply, try_to_lock);
+    if (!applying.owns_lock())
+        return false;
+
+    Batch batch;
+    {
+        lock_guard<mutex> lock(shard.queue);
+        if (shard.batches.empty())
+            return false;
+        batch.swap(shard.batches.front());
+        shard.batches.pop_front();
+    }
+    queued--;
+
+    uint64_t ok = 0, bad = 0;
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        const Transaction& t = batch[i];
+        try
+        {
+            if (t.kind == Transaction::Payment)
+            {
+                ledger.makePayment(t.slot, t.amount);
+                ok++;
+            }
+            else
+            {
+                ok += ledger.chargelt(t.slot, t.amount);
+            }
+        }
+        catch (...)
+        {
+            // out of range amounts and journal errors; the rest of the batch still applies
+            bad++;
+        }
+    }
+    applying.unlock();
+
+    applied  += ok;
+    declined += batch.size() - ok - bad;
+    failed   += bad;
+
+    {
+        // the shard is free again, for a worker waiting on the batches queued behind this one
+        lock_guard<mutex> lock(wake);
+        events++;
+        if (--inFlight == 0)
+            drained.notify_all();
+    }
+    if (queued.load() > 0)
+        wakeup.notify_one();
+    return true;
+}
+
+bool TransactionProcessor::runOne(unsigned worker)
+{
+    size_t n = workerCount;
+
+    // the worker's own shards first: worker, worker + n, worker + 2n, ...
+    for (size_t s = worker; s < shards.size(); s += n)
+        if (runShard(shards[s]))
+            return true;
+
+    // then steal a batch from any other shard
+    for (size_t k = 1; k < shards.size(); k++)
+    {
+        size_t s = (worker + k) % shards.size();
+        if (s % n != worker && runShard(shards[s]))
+        {
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TransactionProcessor::work(unsigned worker)
+{
+    for (;;)
+    {
+        // read before looking, so a batch queued or applied meanwhile is not slept through
+        uint64_t seen = events.load();
+        if (runOne(worker))
+            continue;
+
+        // nothing to take: either no batch is queued, or every shard with one is busy
+        unique_lock<mutex> lock(wake);
+        if (stopping)
+            return;
+        wakeup.wait(lock, [this, seen]() { return stopping || events.load() != seen; });
+    }
+}
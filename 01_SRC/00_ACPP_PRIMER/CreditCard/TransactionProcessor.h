@@ -0,0 +1,103 @@
+/**
+ * This is the header file TransactionProcessor.h, which contains the definition of class
+ * TransactionProcessor
+ *
+ * A TransactionProcessor applies charges and payments to a CardLedger from several worker
+ * threads. Cards are partitioned by a hash of their (packed) number into shards; every shard has
+ * its own queue of transaction batches and is owned by one worker. A worker that has no
+ * work left in its own shards steals whole batches from other shards, one shard at a time,
+ * so the transactions of one card are still applied one after the other, in submit order.
+ *
+ * submit() must be called from one thread, and no cards may be added to the ledger while
+ * transactions are in flight. A transaction that throws, e.g. std::overflow_error from Money
+ * or std::runtime_error from the journal, is counted by getFailed() and the batch goes on
+ * with the next one.
+ */
+
+#ifndef TRANSACTION_PROCESSOR_H
+#define TRANSACTION_PROCESSOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CardLedger.h"
+#include "Money.h"
+
+struct Transaction
+{
+    enum Kind { Charge, Payment };
+
+    CardLedger::Slot    slot;
+    Money               amount;
+    Kind                kind;
+};
+
+class TransactionProcessor
+{
+    public:
+        // workers == 0 uses one worker per hardware thread
+        explicit TransactionProcessor(CardLedger& ledger, unsigned workers = 0, std::size_t batchSize = 4096);
+        ~TransactionProcessor();
+
+                void submit(const Transaction& t);
+                void submit(const Transaction* t, std::size_t count);
+
+                // hands out the partly filled batches and waits until everything is applied
+                void flush();
+
+                std::uint64_t   getApplied()    const { return applied.load() ;}
+                std::uint64_t   getDeclined()   const { return declined.load();}
+                std::uint64_t   getFailed()     const { return failed.load()  ;}
+                std::size_t     getShards()     const { return shards.size()  ;}
+                std::uint64_t   getStolen()     const { return stolen.load()  ;}
+
+    private:
+
+        typedef std::vector<Transaction> Batch;
+
+        struct alignas(64) Shard
+        {
+            std::mutex          apply;      // held while one of the shard's batches is applied
+            std::mutex          queue;      // protects batches
+            std::deque<Batch>   batches;
+            Batch               pending;    // filled by submit(), only touched by the submitting thread
+        };
+
+        TransactionProcessor(const TransactionProcessor&);
+        TransactionProcessor& operator = (const TransactionProcessor&);
+
+        std::size_t shardOf(CardLedger::Slot s);
+        void        push(Shard& shard);
+        bool        runOne(unsigned worker);
+        bool        runShard(Shard& shard);
+        void        work(unsigned worker);
+
+        CardLedger&                 ledger;
+        std::size_t                 batchSize;
+        unsigned                    workerCount;    // fixed before the workers start
+        std::vector<Shard>          shards;
+        std::vector<std::uint32_t>  shardCache;     // shard of every slot seen so far
+        std::vector<std::thread>    workers;
+
+        std::mutex                  wake;
+        std::condition_variable     wakeup;         // a batch was queued or applied, or stop
+        std::condition_variable     drained;        // inFlight dropped to zero
+        std::atomic<std::size_t>    queued;         // batches waiting in a queue
+        std::atomic<std::size_t>    inFlight;       // batches queued or being applied
+        std::atomic<std::uint64_t>  events;         // batches queued and applied so far, changed under wake
+        bool                        stopping;
+
+        std::atomic<std::uint64_t>  applied;
+        std::atomic<std::uint64_t>  declined;
+        std::atomic<std::uint64_t>  failed;
+        std::atomic<std::uint64_t>  stolen;
+
+};
+
+#endif
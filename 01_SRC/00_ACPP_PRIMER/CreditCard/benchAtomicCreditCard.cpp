@@ -0,0 +1,88 @@
+/**
+ * The file benchAtomicCreditCard.cpp, a contention benchmark that lets several threads
+ * charge the same card, once through AtomicCreditCard and once through a CreditCard
+ * guarded by a std::mutex.
+ *
+ *      g++ -std=c++17 -O2 -pthread benchAtomicCreditCard.cpp -o benchAtomicCreditCard
+ *      ./benchAtomicCreditCard [charges per thread]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CardPool.cpp"
+#include "CardLedger.cpp"
+#include "CardBatch.cpp"
+#include "CardJournal.cpp"
+#include "CreditCard.cpp"
+#include "AtomicCreditCard.cpp"
+
+using namespace std;
+
+// the baseline: the plain card with a lock around every charge
+class MutexCreditCard
+{
+    public:
+        MutexCreditCard(const string& no, const string& nm, Money lim) : card(no, nm, lim) {}
+
+        bool chargelt(Money price)
+        {
+            lock_guard<mutex> lock(guard);
+            return card.chargelt(price);
+        }
+        Money getBalance() const { return card.getBalance(); }
+
+    private:
+        CreditCard  card;
+        mutex       guard;
+};
+
+template <typename Card> double run(Card& card, int threads, long charges)
+{
+    vector<thread> workers;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&card, charges]()
+        {
+            for (long i = 0; i < charges; i++)
+                card.chargelt(Money::dollars(1));
+        });
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / (double (threads) * charges);
+}
+
+int main(int argc, char* argv[])
+{
+    long charges = argc > 1 ? atol(argv[1]) : 1000000;
+    int  cores   = int (thread::hardware_concurrency());
+    if (cores < 1)
+        cores = 1;
+
+    cout << "threads\tatomic ns/charge\tmutex ns/charge" << endl;
+    for (int threads = 1; threads <= 2 * cores; threads *= 2)
+    {
+        // the limit is large enough that every charge is accepted
+        Money limit = Money::dollars(threads * charges + 1);
+        AtomicCreditCard atomicCard("5391-0375-9387-5309", "John Bowman", limit);
+        MutexCreditCard  mutexCard ("5391-0375-9387-5309", "John Bowman", limit);
+
+        double a = run(atomicCard, threads, charges);
+        double m = run(mutexCard,  threads, charges);
+
+        if (atomicCard.getBalance() != mutexCard.getBalance())
+        {
+            cout << "balances differ: " << atomicCard.getBalance() << " vs " << mutexCard.getBalance() << endl;
+            return EXIT_FAILURE;
+        }
+        cout << threads << "\t" << a << "\t\t\t" << m << endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+/**
+ * The file benchCreditCard.cpp, the Google Benchmark suite for the CreditCard hot paths:
+ * single card charge and payment latency, batched updates over a wallet, construction
+ * from strings, and formatting throughput, for wallets of 10 to 10M cards.
+ *
+ *      g++ -std=c++17 -O2 benchCreditCard.cpp -lbenchmark -lpthread -o benchCreditCard
+ *      ./benchCreditCard --benchmark_out=creditcard.json --benchmark_out_format=json
+ *
+ * Keep the JSON of every release to compare against (tools/compare.py in Google Benchmark).
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "CardPool.cpp"
+#include "CardLedger.cpp"
+#include "CardBatch.cpp"
+#include "CardJournal.cpp"
+#include "CreditCard.cpp"
+#include "CardFormatter.cpp"
+
+using namespace std;
+
+namespace
+{
+    // a stream that throws its output away, so the formatting is all that is measured
+    class NullBuffer : public streambuf
+    {
+        protected:
+            streamsize xsputn(const char*, streamsize n) { return n; }
+            int        overflow(int c)                   { return c; }
+    };
+
+    const char* cardNumber(char* buf, size_t i)
+    {
+        snprintf(buf, 24, "5391-%04zu-%04zu-%04zu", (i / 100000000) % 10000, (i / 10000) % 10000, i % 10000);
+        return buf;
+    }
+
+    void fill(CardLedger& ledger, size_t n)
+    {
+        char buf[24];
+        ledger.reserve(n);
+        for (size_t i = 0; i < n; i++)
+            ledger.add(cardNumber(buf, i), "John Bowman", Money::dollars(2500));
+    }
+
+    void walletSizes(benchmark::internal::Benchmark* b)
+    {
+        b->RangeMultiplier(10)->Range(10, 10000000);
+    }
+
+    // the cards of fill() take 250000 charges of a cent before they decline everything; the
+    // wallet benchmarks pay the balances back, untimed, every that many charges per card
+    const int64_t chargesToLimit = Money::dollars(2500).getCents();
+
+    class PayBack
+    {
+        public:
+            PayBack(CardLedger& ledger, int64_t chargesPerCard)
+                : ledger(ledger), every(max<int64_t>(1, chargesToLimit / max<int64_t>(1, chargesPerCard))), left(every) {}
+
+            // call once per iteration
+            void operator () (benchmark::State& state)
+            {
+                if (--left > 0)
+                    return;
+                state.PauseTiming();
+                for (CardLedger::Slot s = 0; s < ledger.size(); s++)
+                    ledger.makePayment(s, ledger.getBalance(s));
+                left = every;
+                state.ResumeTiming();
+            }
+
+        private:
+            CardLedger& ledger;
+            int64_t     every;
+            int64_t     left;
+    };
+}
+
+static void BM_Charge(benchmark::State& state)
+{
+    CardLedger ledger;
+    CreditCard card = ledger.card(ledger.add("5391-0375-9387-5309", "John Bowman", Money::dollars(1000000000)));
+    Money      price = Money::cents(1);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(card.chargelt(price));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Charge);
+
+static void BM_MakePayment(benchmark::State& state)
+{
+    CardLedger ledger;
+    CreditCard card    = ledger.card(ledger.add("5391-0375-9387-5309", "John Bowman", Money::dollars(2500)));
+    Money      payment = Money::cents(1);
+
+    for (auto _ : state)
+    {
+        card.makePayment(payment);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_MakePayment);
+
+// one charge per card, one card after the other through the scalar API
+static void BM_WalletChargeScalar(benchmark::State& state)
+{
+    CardLedger ledger;
+    fill(ledger, size_t(state.range(0)));
+    Money   price = Money::cents(1);
+    PayBack payBack(ledger, 1);
+
+    for (auto _ : state)
+    {
+        size_t accepted = 0;
+        for (CardLedger::Slot s = 0; s < ledger.size(); s++)
+            accepted += ledger.chargelt(s, price);
+        benchmark::DoNotOptimize(accepted);
+        payBack(state);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_WalletChargeScalar)->Apply(walletSizes);
+
+// the same work through the SIMD column kernel
+static void BM_WalletChargeEach(benchmark::State& state)
+{
+    CardLedger ledger;
+    fill(ledger, size_t(state.range(0)));
+    vector<Money> prices(ledger.size(), Money::cents(1));
+    PayBack       payBack(ledger, 1);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ledger.chargeEach(prices.data()));
+        payBack(state);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_WalletChargeEach)->Apply(walletSizes);
+
+// charges to random cards, as they arrive from settlement
+static void BM_WalletChargeBatch(benchmark::State& state)
+{
+    CardLedger ledger;
+    fill(ledger, size_t(state.range(0)));
+
+    const size_t             count = 4096;
+    mt19937_64               random(42);
+    vector<CardLedger::Slot> slots(count);
+    vector<Money>            prices(count, Money::cents(1));
+    vector<uint64_t>         rejected((count + 63) / 64);
+    vector<int64_t>          hits(ledger.size(), 0);
+    for (size_t i = 0; i < count; i++)
+    {
+        slots[i] = random() % ledger.size();
+        hits[slots[i]]++;
+    }
+    PayBack payBack(ledger, *max_element(hits.begin(), hits.end()));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ledger.chargeBatch(slots.data(), prices.data(), count, rejected.data()));
+        payBack(state);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(count));
+}
+BENCHMARK(BM_WalletChargeBatch)->Apply(walletSizes);
+
+static void BM_Construct(benchmark::State& state)
+{
+    // pausing the timer costs more than adding ten cards, so the ledger is cleared only once
+    // it holds about a million, and every round adds numbers it does not hold yet
+    size_t         n      = size_t(state.range(0));
+    size_t         rounds = max<size_t>(1, (size_t(1) << 20) / n);
+    vector<char>   numbers(rounds * n * 24);
+    for (size_t i = 0; i < rounds * n; i++)
+        cardNumber(&numbers[i * 24], i);
+
+    CardLedger ledger;
+    ledger.reserve(rounds * n);
+    size_t     round = 0;
+    for (auto _ : state)
+    {
+        if (round == rounds)
+        {
+            state.PauseTiming();
+            ledger.clear();
+            round = 0;
+            state.ResumeTiming();
+        }
+        const char* batch = &numbers[round++ * n * 24];
+        for (size_t i = 0; i < n; i++)
+            ledger.add(batch + i * 24, "John Bowman", Money::dollars(2500));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Construct)->Apply(walletSizes);
+
+// operator << card by card, as testCard() prints
+static void BM_FormatStream(benchmark::State& state)
+{
+    CardLedger ledger;
+    fill(ledger, size_t(state.range(0)));
+    NullBuffer sink;
+    ostream    out(&sink);
+
+    for (auto _ : state)
+        for (CardLedger::Slot s = 0; s < ledger.size(); s++)
+            out << ledger.card(s);
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_FormatStream)->Apply(walletSizes);
+
+static void BM_DumpWallet(benchmark::State& state)
+{
+    CardLedger ledger;
+    fill(ledger, size_t(state.range(0)));
+    NullBuffer sink;
+    ostream    out(&sink);
+    CardFormatter::Format format = state.range(1) ? CardFormatter::Binary : CardFormatter::Text;
+
+    size_t bytes = 0;
+    for (auto _ : state)
+        bytes += dumpWallet(ledger, out, format);
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_DumpWallet)->ArgsProduct({ benchmark::CreateRange(10, 10000000, 10), { 0, 1 } });
+
+BENCHMARK_MAIN();
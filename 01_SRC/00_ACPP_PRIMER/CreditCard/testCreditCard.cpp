@@ -3,34 +3,91 @@
  * for class CreditCard.
  */
 
+#include <cstdio>
 #include <vector>
+#include "CardPool.cpp"
+#include "CardLedger.cpp"
+#include "CardBatch.cpp"
+#include "CardJournal.cpp"
 #include "CreditCard.cpp"
 
 using namespace std;
 
 void testCard()
 {
-    vector<CreditCard*> wallet(10);
+    // the ledger owns the accounts, the wallet only keeps views into it
+    CardLedger ledger;
+    vector<CreditCard> wallet;
 
-    wallet[0] = new CreditCard("5391-0375-9387-5309", "John Bowman", 2500);
-    wallet[1] = new CreditCard("5391-0375-9387-1212", "John Bowman", 5000);
-    wallet[2] = new CreditCard("5391-0375-9387-4232", "John Bowman", 2322);
+    wallet.push_back(ledger.card(ledger.add("5391-0375-9387-5309", "John Bowman", Money::dollars(2500))));
+    wallet.push_back(ledger.card(ledger.add("5391-0375-9387-1212", "John Bowman", Money::dollars(5000))));
+    wallet.push_back(ledger.card(ledger.add("5391-0375-9387-4232", "John Bowman", Money::dollars(2322))));
 
     for (int j = 1; j <= 16; j++)
     {
-        wallet[0] -> chargelt(double(j));
-        wallet[1] -> chargelt(2 *j);
-        wallet[2] -> chargelt(double(3 * j));
+        wallet[0].chargelt(Money::dollars(j));
+        wallet[1].chargelt(Money::dollars(2 *j));
+        wallet[2].chargelt(Money::dollars(3 * j));
 
     }
-    cout << *wallet[0] << endl;
-    cout << *wallet[1] << endl;
-    cout << *wallet[2] << endl;
+    cout << wallet[0] << endl;
+    cout << wallet[1] << endl;
+    cout << wallet[2] << endl;
 
 }
 
+void testJournal()
+{
+    const char* path = "testCreditCard.journal";
+    remove(path);
+
+    // the journal is attached to a ledger that already holds a card, which is not journaled
+    CardLedger ledger;
+    CardLedger::Slot old = ledger.add("5391-0375-9387-5309", "John Bowman", Money::dollars(2500));
+    {
+        CardJournal journal(path);
+        ledger.attach(&journal);
+
+        CardLedger::Slot a = ledger.add("5391-0375-9387-1212", "John Bowman", Money::dollars(5000));
+        CardLedger::Slot b = ledger.add("5391-0375-9387-4232", "John Bowman", Money::dollars(2322));
+        ledger.chargelt(old, Money::dollars(7));
+        ledger.chargelt(a, Money::dollars(120));
+        ledger.chargelt(b, Money::dollars(45));
+        ledger.makePayment(a, Money::dollars(20));
+        ledger.attach(0);
+    }
+
+    // replayed into a ledger that holds other cards, then journaled again
+    CardLedger other;
+    other.add("5391-0375-9387-5309", "John Bowman", Money::dollars(2500));
+    other.add("5391-0375-9387-1212", "John Bowman", Money::dollars(5000));
+    vector<CreditCard> wallet = CardJournal::replay(path, other);
+    {
+        CardJournal journal(path);
+        other.attach(&journal);
+        wallet[1].chargelt(Money::dollars(300));
+        wallet.push_back(other.card(other.add("5391-0375-9387-8888", "John Bowman", Money::dollars(1000))));
+        wallet[2].chargelt(Money::dollars(10));
+        other.attach(0);
+    }
+
+    // a third ledger sees both sessions
+    CardLedger third;
+    third.add("5391-0375-9387-4232", "John Bowman", Money::dollars(2322));
+    vector<CreditCard> replayed = CardJournal::replay(path, third);
+    for (size_t i = 0; i < replayed.size(); i++)
+    {
+        cout << replayed[i] << endl;
+        if (replayed[i].getBalance() != wallet[i].getBalance())
+            cout << "replay differs from the journaled card " << i << endl;
+    }
+
+    remove(path);
+}
+
 int main()
 {
     testCard();
+    testJournal();
     return EXIT_SUCCESS;
 }
@@ -1,9 +1,16 @@
 #include <iostream>
+#include "async_log.h"
+#include "log_levels.h"
 using namespace std;
 
 
+// with log_start() the three lines become one record for the background writer, otherwise
+// they go to std::cout, in order with everything else the program prints
 void Log(const char* message)
 {
+    if (log_push({ "-------------------------------------------------------------- \n", message, "\n",
+                   "-------------------------------------------------------------- \n" }))
+        return;
     std::cout << "-------------------------------------------------------------- \n";
     std::cout << message << std::endl;
     std::cout << "-------------------------------------------------------------- \n";
@@ -11,8 +18,19 @@ void Log(const char* message)
 
 void printing_message(const char* message)
 {
+    if (log_push({ "------------------------------------------- \n", message, "\n",
+                   "------------------------------------------- \n" }))
+        return;
     cout << "------------------------------------------- \n";
     cout << message << endl;
     cout << "------------------------------------------- \n";
 }
 
+// a leveled line with key/value fields, see log_levels.h:
+//      Log<log_debug>(net, "connected", kv("peer", address));
+// compiles to nothing below LOG_COMPILED_LEVEL
+template <log_level L, typename... Fields>
+void Log(const log_category& category, const char* message, const Fields&... fields)
+{
+    log_at<L>(category, message, fields...);
+}
@@ -0,0 +1,432 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Asynchronous logging. A record is copied into a ring buffer owned by the calling thread,
+ * with no lock and no system call; one background thread drains every ring and hands the
+ * records in large batches to a sink.
+ *
+ *  log_start(sink)     starts the writer; fd_sink writes to a file descriptor, file_sink to a file,
+ *                      mmap_sink (mmap_sink.h) to mapped files that it rotates and compresses
+ *  log_push(parts)     appends one record, the concatenation of parts; false when not started,
+ *                      or when the logger stopped while it waited for room
+ *  log_flush()         returns once every record pushed before the call has been written
+ *  log_stop()          writes what is left and stops the writer; records pushed while it
+ *                      runs may be dropped
+ *
+ * Records from one thread are written in the order they were pushed; records from different
+ * threads are interleaved batch by batch. A thread whose ring is full waits for the writer
+ * rather than dropping records, until log_stop(). Log() and printing_message() go through here
+ * once log_start() has been called, and print to std::cout as before otherwise: the async
+ * records are not ordered with other writes to the same stream, so send them to a file or to
+ * stderr when the program also prints.
+ */
+
+// where the writer thread puts the batches; write() and flush() are only called from there
+class log_sink
+{
+public:
+    virtual ~log_sink() {}
+    virtual void write(const char* data, std::size_t size) = 0;
+    virtual void flush() {}
+    // bytes every file of the log must start with, as the header of a binary log: now goes at
+    // the top of this one, and a sink that starts new files, as mmap_sink does, puts later()
+    // at the top of each of them; called before log_start()
+    virtual void set_prologue(const std::string& now, std::function<std::string()> later)
+    {
+        (void)later;
+        write(now.data(), now.size());
+    }
+};
+
+class fd_sink : public log_sink
+{
+public:
+    explicit fd_sink(int fd) : fd(fd) {}
+
+    void write(const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return;     // nobody to report to on the writer thread; the batch is lost
+            data += n;
+            size -= std::size_t(n);
+        }
+    }
+
+protected:
+    int fd;
+};
+
+// appends to a file, or truncates it first; throws std::runtime_error when it cannot be opened
+class file_sink : public fd_sink
+{
+public:
+    explicit file_sink(const char* path, bool truncate = false)
+        : fd_sink(::open(path, O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND), 0644))
+    {
+        if (fd < 0)
+            throw std::runtime_error(std::string("log: cannot open ") + path);
+    }
+    ~file_sink()    { ::close(fd); }
+};
+
+namespace log_detail
+{
+    const std::size_t ring_bytes    = 64 * 1024;        // per thread, a power of two
+    const std::size_t max_record    = ring_bytes / 2;   // longer records are cut, see log_push()
+    const std::size_t batch_bytes   = 256 * 1024;       // the writer hands the sink this much at most
+
+    // in a binary log (binary_log.h) a text record is this byte, a 4-byte length and the text
+    const char text_record = 't';
+
+    // single producer (the owning thread), single consumer (the writer); head and tail count
+    // bytes ever written and read, and every record is a 4-byte length and the bytes
+    struct ring
+    {
+        alignas(64) std::atomic<std::uint64_t> head;
+        std::uint64_t                          cached_tail;    // the producer's last look at tail
+        alignas(64) std::atomic<std::uint64_t> tail;
+        std::atomic<bool>                      closed;         // the thread has exited
+        char                                   data[ring_bytes];
+
+        ring() : head(0), cached_tail(0), tail(0), closed(false) {}
+
+        void copy_in(std::uint64_t at, const void* from, std::size_t n)
+        {
+            std::size_t pos   = std::size_t(at % ring_bytes);
+            std::size_t first = n < ring_bytes - pos ? n : ring_bytes - pos;
+            std::memcpy(data + pos, from, first);
+            std::memcpy(data, static_cast<const char*>(from) + first, n - first);
+        }
+
+        void copy_out(std::uint64_t at, void* to, std::size_t n) const
+        {
+            std::size_t pos   = std::size_t(at % ring_bytes);
+            std::size_t first = n < ring_bytes - pos ? n : ring_bytes - pos;
+            std::memcpy(to, data + pos, first);
+            std::memcpy(static_cast<char*>(to) + first, data, n - first);
+        }
+    };
+
+    struct logger
+    {
+        std::mutex                  lock;       // rings; log_push takes it only to add a thread's ring
+        std::vector<ring*>          rings;
+        std::unique_ptr<log_sink>   sink;
+        std::thread                 writer;
+        std::atomic<bool>           running;
+        std::atomic<bool>           stopping;
+        std::atomic<bool>           framed;     // a binary log: text records get a header too
+        std::atomic<std::uint64_t>  passes;     // complete drains of every ring
+        std::atomic<int>            waiting;    // threads in log_flush()
+        std::mutex                  pass_lock;
+        std::condition_variable     pass_done;
+
+        logger() : running(false), stopping(false), framed(false), passes(0), waiting(0) {}
+        ~logger();
+    };
+
+    inline logger& state()
+    {
+        static logger l;
+        return l;
+    }
+
+    // marks the ring closed when its thread exits; the writer frees it once it is empty
+    struct ring_owner
+    {
+        ring* r;
+
+        ring_owner() : r(0) {}
+        ~ring_owner()
+        {
+            if (r)
+                r->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    inline ring& local_ring()
+    {
+        thread_local ring_owner owner;
+        if (owner.r == 0)
+        {
+            owner.r = new ring;
+            logger& l = state();
+            std::lock_guard<std::mutex> hold(l.lock);
+            l.rings.push_back(owner.r);
+        }
+        return *owner.r;
+    }
+
+    // room for a size-byte record in the calling thread's ring, waiting for the writer while
+    // the ring is full; the record is copied in from at, then committed. False, with nothing
+    // reserved, when the logger stops while the ring is full, since nobody would empty it
+    inline bool reserve(ring& r, std::size_t size, std::uint64_t& at)
+    {
+        std::uint64_t h    = r.head.load(std::memory_order_relaxed);
+        std::uint64_t need = sizeof(std::uint32_t) + size;
+        while (h + need - r.cached_tail > ring_bytes)
+        {
+            r.cached_tail = r.tail.load(std::memory_order_acquire);
+            if (h + need - r.cached_tail > ring_bytes)
+            {
+                if (!state().running.load(std::memory_order_acquire))
+                    return false;
+                std::this_thread::yield();
+            }
+        }
+        std::uint32_t length = std::uint32_t(size);
+        r.copy_in(h, &length, sizeof length);
+        at = h + sizeof length;
+        return true;
+    }
+
+    // publishes everything before end to the writer
+    inline void commit(ring& r, std::uint64_t end)
+    {
+        r.head.store(end, std::memory_order_release);
+    }
+
+    // moves the complete records of r into batch until it would go over batch_bytes; false when
+    // it stopped there
+    inline bool take(ring& r, std::vector<char>& batch, std::size_t& taken)
+    {
+        std::uint64_t h = r.head.load(std::memory_order_acquire);
+        std::uint64_t t = r.tail.load(std::memory_order_relaxed);
+        while (t < h)
+        {
+            std::uint32_t size;
+            r.copy_out(t, &size, sizeof size);
+            if (batch.size() + size > batch_bytes && !batch.empty())
+                return false;
+            std::size_t at = batch.size();
+            batch.resize(at + size);
+            r.copy_out(t + sizeof size, batch.data() + at, size);
+            t     += sizeof size + size;
+            taken += sizeof size + size;
+            // free the space record by record, so that a waiting producer can go on
+            r.tail.store(t, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // empties every ring into the sink, a batch at a time; the lock is held while records are
+    // copied out, never while the sink writes. Returns how many bytes were taken from the rings
+    inline std::size_t drain(logger& l, std::vector<char>& batch)
+    {
+        std::size_t taken = 0;
+        std::size_t start = 0;     // where the last batch filled up, so every ring gets its turn
+        for (;;)
+        {
+            bool full = false;
+            {
+                std::lock_guard<std::mutex> hold(l.lock);
+                std::size_t n = l.rings.size();
+                for (std::size_t k = 0; k < n && !full; k++)
+                {
+                    std::size_t i = (start + k) % n;
+                    full  = !take(*l.rings[i], batch, taken);
+                    start = i;
+                }
+                // the rings of exited threads, once empty; closed is read before head, and the
+                // thread pushed nothing after closing
+                for (std::size_t i = 0; !full && i < l.rings.size(); )
+                {
+                    ring& r = *l.rings[i];
+                    if (r.closed.load(std::memory_order_acquire) &&
+                        r.tail.load(std::memory_order_relaxed) == r.head.load(std::memory_order_acquire))
+                    {
+                        delete l.rings[i];
+                        l.rings[i] = l.rings.back();
+                        l.rings.pop_back();
+                    }
+                    else
+                        i++;
+                }
+            }
+            // only the writer thread uses the sink while the logger runs
+            if (!batch.empty())
+            {
+                l.sink->write(batch.data(), batch.size());
+                batch.clear();
+            }
+            if (!full)
+                return taken;
+        }
+    }
+
+    inline void write_loop(logger& l)
+    {
+        std::vector<char> batch;
+        batch.reserve(batch_bytes);
+        unsigned idle = 0;
+        for (;;)
+        {
+            bool stopping     = l.stopping.load(std::memory_order_acquire);
+            std::size_t taken = drain(l, batch);
+            if (l.waiting.load(std::memory_order_acquire) > 0)
+            {
+                l.sink->flush();
+                std::lock_guard<std::mutex> hold(l.pass_lock);
+                l.passes.fetch_add(1, std::memory_order_release);
+                l.pass_done.notify_all();
+            }
+            else
+                l.passes.fetch_add(1, std::memory_order_release);
+
+            if (taken)
+                idle = 0;
+            else if (stopping)
+                break;
+            else
+            {
+                // back off from 10 us to 1 ms while there is nothing to write
+                idle = idle < 7 ? idle + 1 : idle;
+                std::this_thread::sleep_for(std::chrono::microseconds(10u << idle));
+            }
+        }
+        l.sink->flush();
+        // release anyone still in log_flush()
+        std::lock_guard<std::mutex> hold(l.pass_lock);
+        l.passes.fetch_add(2, std::memory_order_release);
+        l.pass_done.notify_all();
+    }
+
+    inline logger::~logger()
+    {
+        if (writer.joinable())
+        {
+            stopping.store(true, std::memory_order_release);
+            writer.join();
+        }
+        for (std::size_t i = 0; i < rings.size(); i++)
+            delete rings[i];
+    }
+}
+
+namespace log_detail
+{
+    inline void start(std::unique_ptr<log_sink> sink, bool framed)
+    {
+        logger& l = state();
+        std::lock_guard<std::mutex> hold(l.lock);
+        if (l.running.load(std::memory_order_relaxed))
+            throw std::logic_error("log_start: the logger is already running");
+        // drop what was pushed while the last writer was stopping, which may be of the other kind
+        for (std::size_t i = 0; i < l.rings.size(); i++)
+            l.rings[i]->tail.store(l.rings[i]->head.load(std::memory_order_acquire), std::memory_order_release);
+        l.sink = std::move(sink);
+        l.stopping.store(false, std::memory_order_relaxed);
+        l.framed.store(framed, std::memory_order_relaxed);
+        l.writer = std::thread(write_loop, std::ref(l));
+        l.running.store(true, std::memory_order_release);
+    }
+}
+
+// throws std::logic_error when already started
+inline void log_start(std::unique_ptr<log_sink> sink)
+{
+    log_detail::start(std::move(sink), false);
+}
+
+inline bool log_running()
+{
+    return log_detail::state().running.load(std::memory_order_acquire);
+}
+
+inline bool log_push(std::initializer_list<std::string_view> parts)
+{
+    using namespace log_detail;
+
+    if (!log_running())
+        return false;
+
+    std::size_t size = 0;
+    for (std::string_view p : parts)
+        size += p.size();
+    // a record that is too long keeps its first max_record - 1 bytes and its last one, usually
+    // the newline
+    char last = 0;
+    for (std::string_view p : parts)
+        last = p.empty() ? last : p.back();
+    bool cut = size > max_record;
+    if (cut)
+        size = max_record - 1;
+
+    ring& r          = local_ring();
+    bool framed      = state().framed.load(std::memory_order_relaxed);
+    std::uint32_t n  = std::uint32_t(size + cut);
+    std::uint64_t at;
+    if (!reserve(r, (framed ? 1 + sizeof n : 0) + n, at))
+        return false;
+    if (framed)
+    {
+        r.copy_in(at, &text_record, 1);
+        r.copy_in(at + 1, &n, sizeof n);
+        at += 1 + sizeof n;
+    }
+    for (std::string_view p : parts)
+    {
+        std::size_t part = p.size() < size ? p.size() : size;
+        r.copy_in(at, p.data(), part);
+        at   += part;
+        size -= part;
+    }
+    if (cut)
+        r.copy_in(at++, &last, 1);
+    commit(r, at);
+    return true;
+}
+
+inline void log_flush()
+{
+    log_detail::logger& l = log_detail::state();
+    if (!log_running())
+        return;
+    l.waiting.fetch_add(1, std::memory_order_acq_rel);
+    {
+        // the pass after the one in progress started after this call, and drains all of it
+        std::unique_lock<std::mutex> hold(l.pass_lock);
+        std::uint64_t target = l.passes.load(std::memory_order_acquire) + 2;
+        l.pass_done.wait(hold, [&]() { return l.passes.load(std::memory_order_acquire) >= target; });
+    }
+    l.waiting.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+inline void log_stop()
+{
+    log_detail::logger& l = log_detail::state();
+    if (!l.running.exchange(false, std::memory_order_acq_rel))
+        return;
+    l.stopping.store(true, std::memory_order_release);
+    l.writer.join();
+    std::lock_guard<std::mutex> hold(l.lock);
+    l.sink.reset();
+}
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * bench_log.cpp: the cost of one Log() call, printing to std::cout as before and through the
+ * asynchronous backend of async_log.h, and of a line with arguments formatted on the calling
+ * thread against LOG_BINARY of binary_log.h and LOG_INFO of log_levels.h, which also costs a
+ * line whose level is turned off. Standard output goes to /dev/null while timing.
+ *
+ *      g++ -std=c++17 -O2 -pthread bench_log.cpp -o bench_log
+ *      ./bench_log [calls]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Log.cpp"
+#include "binary_log.h"
+#include "log_levels.h"
+
+using namespace std;
+
+template <typename F> double seconds(F f)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    long calls = argc > 1 ? atol(argv[1]) : 1000000;
+    int null   = open("/dev/null", O_WRONLY);
+    int out    = dup(1);
+
+    // the calls, with stdout on /dev/null; the async time includes the final flush
+    dup2(null, 1);
+    double sync = seconds([&]() { for (long i = 0; i < calls; i++) Log("Hello world!!"); cout.flush(); });
+
+    log_start(unique_ptr<log_sink>(new fd_sink(null)));
+    double push = 0;
+    double async = seconds([&]()
+    {
+        push = seconds([&]() { for (long i = 0; i < calls; i++) Log("Hello world!!"); });
+        log_flush();
+    });
+
+    // bursts that fit in the ring, so the caller never waits for the writer: the cost of a
+    // call on a machine with a core to spare for the writer
+    const long burst = 256;
+    double burst_push = 0;
+    for (long done = 0; done < calls; done += burst)
+    {
+        burst_push += seconds([&]() { for (long i = 0; i < burst; i++) Log("Hello world!!"); });
+        log_flush();
+    }
+
+    // a line with arguments, formatted here, then pushed as text
+    double formatted = 0;
+    for (long done = 0; done < calls; done += burst)
+    {
+        formatted += seconds([&]()
+        {
+            for (long i = 0; i < burst; i++)
+            {
+                char line[128];
+                int n = snprintf(line, sizeof line, "order %ld filled at %.2f for %s\n", done + i, 99.5, "ACC-42");
+                log_push({ string_view(line, size_t(n)) });
+            }
+        });
+        log_flush();
+    }
+
+    // the same line with fields, and with its category turned off
+    static log_category orders("orders");
+    double leveled = 0;
+    for (long done = 0; done < calls; done += burst)
+    {
+        leveled += seconds([&]()
+        {
+            for (long i = 0; i < burst; i++)
+                LOG_INFO(orders, "order filled", kv("order", done + i), kv("price", 99.5), kv("account", "ACC-42"));
+        });
+        log_flush();
+    }
+    log_set_level("orders", log_warn);
+    double disabled = seconds([&]()
+    {
+        for (long i = 0; i < calls; i++)
+            LOG_INFO(orders, "order filled", kv("order", i), kv("price", 99.5), kv("account", "ACC-42"));
+    });
+    log_stop();
+
+    // the same line through the binary log
+    binary_log_start("/dev/null");
+    double binary = 0;
+    for (long done = 0; done < calls; done += burst)
+    {
+        binary += seconds([&]()
+        {
+            for (long i = 0; i < burst; i++)
+                LOG_BINARY("order %ld filled at %.2f for %s", done + i, 99.5, "ACC-42");
+        });
+        log_flush();
+    }
+    log_stop();
+    dup2(out, 1);
+
+    printf("%ld calls of Log(\"Hello world!!\")\n", calls);
+    printf("  std::cout with endl          %8.1f ns/call\n", 1e9 * sync / calls);
+    printf("  async, caller                %8.1f ns/call\n", 1e9 * push / calls);
+    printf("  async, until written         %8.1f ns/call\n", 1e9 * async / calls);
+    long bursts = (calls + burst - 1) / burst * burst;
+    printf("  async, caller, in bursts     %8.1f ns/call\n", 1e9 * burst_push / bursts);
+    printf("\"order %%ld filled at %%.2f for %%s\", in bursts\n");
+    printf("  snprintf and log_push        %8.1f ns/call\n", 1e9 * formatted / bursts);
+    printf("  LOG_BINARY                   %8.1f ns/call\n", 1e9 * binary / bursts);
+    printf("  LOG_INFO with fields         %8.1f ns/call\n", 1e9 * leveled / bursts);
+    printf("  LOG_INFO, category at warn   %8.1f ns/call\n", 1e9 * disabled / calls);
+    return 0;
+}
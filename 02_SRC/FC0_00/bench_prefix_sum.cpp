@@ -0,0 +1,88 @@
+/**
+ * bench_prefix_sum.cpp: throughput and accuracy of the prefix sum modes on a long series of
+ * amounts, against a reference summed in long double with compensation.
+ *
+ *      g++ -std=c++17 -O2 -pthread bench_prefix_sum.cpp -o bench_prefix_sum
+ *      ./bench_prefix_sum [elements]
+ *
+ * CPU_LEVEL=sse4.2 ./bench_prefix_sum times the SSE2 kernels on an AVX2 machine (cpu_dispatch.h).
+ * Do not build with -ffast-math: it lets the compiler drop the compensation.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "prefix_scan.h"
+
+using namespace std;
+
+struct result
+{
+    double ns;          // per element
+    double max_abs;     // largest |c[j] - reference[j]|
+    double max_rel;     // largest of the same, relative to |reference[j]|
+};
+
+template <typename F>
+result run(F scan, const vector<double>& a, vector<double>& c, const vector<long double>& reference)
+{
+    const int repeats = 5;
+    double best = 1e300;
+    for (int r = 0; r < repeats; r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        scan(a.data(), c.data(), a.size());
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    result out = { best / a.size(), 0.0, 0.0 };
+    for (size_t j = 0; j < a.size(); j++)
+    {
+        long double err = fabsl(c[j] - reference[j]);
+        if (err > out.max_abs)
+            out.max_abs = double(err);
+        if (reference[j] != 0 && err / fabsl(reference[j]) > out.max_rel)
+            out.max_rel = double(err / fabsl(reference[j]));
+    }
+    return out;
+}
+
+void print(const char* name, const result& r)
+{
+    printf("%-24s %8.3f ns/elem %9.1f Melem/s   max abs err %.3e   max rel err %.3e\n",
+           name, r.ns, 1e3 / r.ns, r.max_abs, r.max_rel);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], 0, 10) : size_t(1) << 24;
+
+    // amounts in cents with a drift, the shape of a long ledger: many small values that do
+    // not sum exactly in binary, on top of a growing balance
+    vector<double> a(n), c(n);
+    mt19937_64 random(42);
+    uniform_int_distribution<int> cents(-100000, 100500);
+    for (size_t j = 0; j < n; j++)
+        a[j] = cents(random) / 100.0;
+
+    vector<long double> reference(n), series(a.begin(), a.end());
+    scan_detail::scan_compensated_serial(series.data(), reference.data(), n, scan_detail::compensated<long double>());
+
+    printf("%zu elements, %u hardware threads\n", n, thread::hardware_concurrency());
+    print("serial loop", run([](const double* x, double* y, size_t m)
+                             { scan_detail::scan_serial(x, y, m, 0.0); }, a, c, reference));
+    print("fast", run([](const double* x, double* y, size_t m)
+                      { prefix_sum(x, y, m, scan_fast, 1); }, a, c, reference));
+    print("fast, threads", run([](const double* x, double* y, size_t m)
+                               { prefix_sum(x, y, m, scan_fast); }, a, c, reference));
+    print("compensated", run([](const double* x, double* y, size_t m)
+                             { prefix_sum(x, y, m, scan_compensated, 1); }, a, c, reference));
+    print("compensated, threads", run([](const double* x, double* y, size_t m)
+                                      { prefix_sum(x, y, m, scan_compensated); }, a, c, reference));
+    return 0;
+}
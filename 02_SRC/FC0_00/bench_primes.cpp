@@ -0,0 +1,110 @@
+/**
+ * bench_primes.cpp: isPrime and primeCount against the trial division of surprise(), which
+ * divided every i by 2, 3, ... until a divisor turned up.
+ *
+ *      g++ -std=c++17 -O2 -pthread bench_primes.cpp -o bench_primes
+ *      ./bench_primes
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "primality.h"
+
+using namespace std;
+
+// the loop of the old surprise()
+bool trial_division(uint64_t i)
+{
+    if (i < 2)
+        return false;
+    uint64_t j = 2;
+    while (i % j++ != 0);
+    return j == i + 1;
+}
+
+// trial division up to sqrt(i), the usual improvement
+bool trial_division_sqrt(uint64_t i)
+{
+    if (i < 2)
+        return false;
+    for (uint64_t j = 2; j * j <= i; j++)
+        if (i % j == 0)
+            return false;
+    return true;
+}
+
+template <typename F> double seconds(F f)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename Test> void test_each(const char* name, const vector<uint64_t>& n, Test test)
+{
+    size_t primes = 0;
+    double s = seconds([&]() { for (size_t i = 0; i < n.size(); i++) primes += test(n[i]); });
+    printf("  %-22s %10.1f ns/number  (%zu primes)\n", name, 1e9 * s / n.size(), primes);
+}
+
+void test_batch(const vector<uint64_t>& n)
+{
+    unique_ptr<bool[]> out(new bool[n.size()]);
+    size_t primes = 0;
+    double s = seconds([&]()
+    {
+        isPrime(n.data(), out.get(), n.size());
+        for (size_t i = 0; i < n.size(); i++)
+            primes += out[i];
+    });
+    printf("  %-22s %10.1f ns/number  (%zu primes)\n", "isPrime, batched", 1e9 * s / n.size(), primes);
+}
+
+int main()
+{
+    mt19937_64 random(42);
+
+    vector<uint64_t> small;
+    for (uint64_t i = 2; i <= 20000; i++)
+        small.push_back(i);
+    printf("every number in [2, 20000]\n");
+    test_each("trial division", small, trial_division);
+    test_each("trial division, sqrt", small, trial_division_sqrt);
+    test_each("isPrime", small, [](uint64_t i) { return isPrime(i); });
+    test_batch(small);
+
+    vector<uint64_t> word(1000000);
+    for (size_t i = 0; i < word.size(); i++)
+        word[i] = (random() >> 32) | 1;
+    printf("1M random odd 32-bit numbers\n");
+    test_each("trial division, sqrt", word, trial_division_sqrt);
+    test_each("isPrime", word, [](uint64_t i) { return isPrime(i); });
+    test_batch(word);
+
+    vector<uint64_t> wide(1000000);
+    for (size_t i = 0; i < wide.size(); i++)
+        wide[i] = random() | 1;
+    printf("1M random odd 64-bit numbers\n");
+    test_each("isPrime", wide, [](uint64_t i) { return isPrime(i); });
+    test_batch(wide);
+
+    printf("pi(x)\n");
+    for (uint64_t x = 10000; x <= 1000000000000000ull; x *= 100)
+    {
+        uint64_t a = 0, b = 0, c = 0;
+        double tp = seconds([&]() { a = primeCount(x); });
+        double ts = x <= 100000000000ull ? seconds([&]() { b = count_primes(0, x); }) : 0;
+        double tt = x <= 10000 ? seconds([&]() { for (uint64_t i = 2; i <= x; i++) c += trial_division(i); }) : 0;
+        printf("  x = %-15llu %-13llu primeCount %9.4f s", (unsigned long long) x, (unsigned long long) a, tp);
+        if (ts > 0)
+            printf("   sieve %9.4f s%s", ts, a == b ? "" : " MISMATCH");
+        if (tt > 0)
+            printf("   trial division %9.4f s%s", tt, a == c ? "" : " MISMATCH");
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,496 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "async_log.h"
+
+/**
+ * Binary logging with deferred formatting. A call site
+ *
+ *      LOG_BINARY("order %d filled at %.2f for %s", id, price, account);
+ *
+ * is registered on its first run: its printf format, file, line and argument types, which the
+ * compiler works out, get a small id. After that a record is the id, a timestamp and the raw
+ * bytes of the arguments, copied into the rings of async_log.h; nothing is formatted on the
+ * calling thread. log_decode turns the file into text later.
+ *
+ *  binary_log_start(path)      log_start() into a new binary file, which also takes Log() and
+ *                              the other text records; binary_log_start(sink) into any sink,
+ *                              such as the rotating mmap_sink
+ *  LOG_BINARY(format, ...)     one line; without a binary log it is formatted on the spot and
+ *                              goes to log_push(), or to stdout when the logger is not running
+ *
+ * Up to 32 arguments: integers, bool, char, float, double, strings (const char*, std::string,
+ * std::string_view; at most 1 KiB of each is kept) and other pointers, which are logged as
+ * addresses. Formats and file names are kept up to 1 KiB too.
+ *
+ * The file, little endian: "BLOG", u32 version, u64 system clock and u64 steady clock in ns at
+ * the start, then records that start with a byte:
+ *
+ *  'S'  u32 id, u32 line, u16 size + file, u16 size + format, u8 count + type codes
+ *  'r'  u32 id, u64 steady clock ns, u16 size + the arguments (strings as u32 size + bytes)
+ *  't'  u32 size + text
+ *
+ * A call site is described somewhere in the file, but not always before its first record,
+ * because another thread's ring may be written first; decoders read the 'S' records first,
+ * skipping the others by their sizes.
+ */
+
+namespace binlog_detail
+{
+    const std::uint32_t version    = 1;
+    const std::size_t   max_string = 1024;
+
+    struct pointer_arg
+    {
+        std::uint64_t address;
+    };
+
+    // every argument is stored as one of these
+    inline bool             store(bool x)               { return x; }
+    inline char             store(char x)               { return x; }
+    inline std::int32_t     store(signed char x)        { return x; }
+    inline std::int32_t     store(short x)              { return x; }
+    inline std::int32_t     store(int x)                { return x; }
+    inline std::uint32_t    store(unsigned char x)      { return x; }
+    inline std::uint32_t    store(unsigned short x)     { return x; }
+    inline std::uint32_t    store(unsigned x)           { return x; }
+    inline std::int64_t     store(long x)               { return x; }
+    inline std::int64_t     store(long long x)          { return x; }
+    inline std::uint64_t    store(unsigned long x)      { return x; }
+    inline std::uint64_t    store(unsigned long long x) { return x; }
+    inline double           store(float x)              { return x; }
+    inline double           store(double x)             { return x; }
+    inline double           store(long double x)        { return double(x); }
+    inline std::string_view store(const char* x)        { return x ? std::string_view(x) : std::string_view("(null)"); }
+    inline std::string_view store(char* x)              { return store(const_cast<const char*>(x)); }
+    inline std::string_view store(const std::string& x) { return x; }
+    inline std::string_view store(std::string_view x)   { return x; }
+    template <typename T> pointer_arg store(T* x)       { pointer_arg p = { std::uint64_t(std::uintptr_t(x)) }; return p; }
+
+    template <typename T> struct code;
+    template <> struct code<bool>               { static const char value = 'b'; };
+    template <> struct code<char>               { static const char value = 'c'; };
+    template <> struct code<std::int32_t>       { static const char value = 'i'; };
+    template <> struct code<std::uint32_t>      { static const char value = 'u'; };
+    template <> struct code<std::int64_t>       { static const char value = 'I'; };
+    template <> struct code<std::uint64_t>      { static const char value = 'U'; };
+    template <> struct code<double>             { static const char value = 'd'; };
+    template <> struct code<std::string_view>   { static const char value = 's'; };
+    template <> struct code<pointer_arg>        { static const char value = 'p'; };
+
+    // the type codes of a call, as a string built by the compiler
+    template <typename... A> struct signature
+    {
+        static constexpr char codes[sizeof...(A) + 1] = { code<decltype(store(std::declval<const A&>()))>::value..., 0 };
+    };
+
+    template <typename T> std::size_t stored_size(T)    { return sizeof(T); }
+    inline std::size_t stored_size(std::string_view s)  { return sizeof(std::uint32_t) + (s.size() < max_string ? s.size() : max_string); }
+    inline std::size_t stored_size(pointer_arg)         { return sizeof(std::uint64_t); }
+
+    template <typename Out, typename T> void put(Out& out, T x)     { out.write(&x, sizeof x); }
+    template <typename Out> void put(Out& out, pointer_arg p)       { out.write(&p.address, sizeof p.address); }
+    template <typename Out> void put(Out& out, std::string_view s)
+    {
+        std::uint32_t n = std::uint32_t(s.size() < max_string ? s.size() : max_string);
+        out.write(&n, sizeof n);
+        out.write(s.data(), n);
+    }
+
+    // where put() writes: the calling thread's ring, or a string
+    struct ring_out
+    {
+        log_detail::ring&   r;
+        std::uint64_t       at;
+
+        void write(const void* p, std::size_t n)    { r.copy_in(at, p, n); at += n; }
+    };
+
+    struct string_out
+    {
+        std::string&        s;
+
+        void write(const void* p, std::size_t n)    { s.append(static_cast<const char*>(p), n); }
+    };
+
+    inline std::uint64_t steady_ns()
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    inline std::uint64_t system_ns()
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    struct site
+    {
+        std::string     format;
+        std::string     file;
+        std::uint32_t   line;
+        std::string     codes;
+    };
+
+    struct site_table
+    {
+        std::mutex          lock;       // also held while a binary log starts
+        std::vector<site>   sites;
+    };
+
+    inline site_table& sites()
+    {
+        static site_table t;
+        return t;
+    }
+
+    // the 'S' record of a call site
+    inline std::string describe(std::uint32_t id, const site& s)
+    {
+        std::string out;
+        string_out o = { out };
+        std::uint16_t file_size   = std::uint16_t(s.file.size() < max_string ? s.file.size() : max_string);
+        std::uint16_t format_size = std::uint16_t(s.format.size() < max_string ? s.format.size() : max_string);
+        put(o, 'S');
+        put(o, id);
+        put(o, s.line);
+        put(o, file_size);
+        o.write(s.file.data(), file_size);
+        put(o, format_size);
+        o.write(s.format.data(), format_size);
+        put(o, std::uint8_t(s.codes.size()));
+        o.write(s.codes.data(), s.codes.size());
+        return out;
+    }
+
+    inline bool binary_running()
+    {
+        log_detail::logger& l = log_detail::state();
+        return l.running.load(std::memory_order_acquire) && l.framed.load(std::memory_order_relaxed);
+    }
+
+    inline std::uint32_t register_site(const char* format, const char* file, unsigned line, const char* codes)
+    {
+        site_table& t = sites();
+        std::uint32_t id;
+        std::string record;
+        {
+            std::lock_guard<std::mutex> hold(t.lock);
+            id = std::uint32_t(t.sites.size());
+            site s = { format, file, std::uint32_t(line), codes };
+            t.sites.push_back(s);
+            if (binary_running())
+                record = describe(id, s);
+        }
+        // a running binary log learns about the site from this thread's ring, ahead of its
+        // records; outside the lock, which the writer takes to start a new segment
+        if (!record.empty())
+        {
+            log_detail::ring& r = log_detail::local_ring();
+            std::uint64_t at;
+            if (log_detail::reserve(r, record.size(), at))
+            {
+                r.copy_in(at, record.data(), record.size());
+                log_detail::commit(r, at + record.size());
+            }
+        }
+        return id;
+    }
+
+    // one stored argument, read back
+    struct arg
+    {
+        char                code;
+        long long           i;          // the integer codes, char and bool
+        unsigned long long  u;          // 'u', 'U' and 'p'
+        double              d;
+        std::string_view    s;
+    };
+
+    template <typename T> bool take(const char*& p, const char* end, T& x)
+    {
+        if (std::size_t(end - p) < sizeof x)
+            return false;
+        std::memcpy(&x, p, sizeof x);
+        p += sizeof x;
+        return true;
+    }
+
+    inline bool read_arg(char c, const char*& p, const char* end, arg& a)
+    {
+        a = arg();
+        a.code = c;
+        switch (c)
+        {
+        case 'b': { bool x;          if (!take(p, end, x)) return false; a.i = x; break; }
+        case 'c': { char x;          if (!take(p, end, x)) return false; a.i = x; break; }
+        case 'i': { std::int32_t x;  if (!take(p, end, x)) return false; a.i = x; break; }
+        case 'I': { std::int64_t x;  if (!take(p, end, x)) return false; a.i = x; break; }
+        case 'u': { std::uint32_t x; if (!take(p, end, x)) return false; a.u = x; break; }
+        case 'U':
+        case 'p': { std::uint64_t x; if (!take(p, end, x)) return false; a.u = x; break; }
+        case 'd': { if (!take(p, end, a.d)) return false; break; }
+        case 's':
+        {
+            std::uint32_t n;
+            if (!take(p, end, n) || std::size_t(end - p) < n)
+                return false;
+            a.s = std::string_view(p, n);
+            p += n;
+            break;
+        }
+        default:
+            return false;
+        }
+        return true;
+    }
+
+    inline bool is_signed(const arg& a)     { return a.code == 'b' || a.code == 'c' || a.code == 'i' || a.code == 'I'; }
+    inline long long as_signed(const arg& a)
+    {
+        return a.code == 'd' ? (long long)(a.d) : is_signed(a) ? a.i : (long long)(a.u);
+    }
+    inline unsigned long long as_unsigned(const arg& a)
+    {
+        return a.code == 'd' ? (unsigned long long)(a.d) : is_signed(a) ? (unsigned long long)(a.i) : a.u;
+    }
+    inline double as_double(const arg& a)
+    {
+        return a.code == 'd' ? a.d : is_signed(a) ? double(a.i) : double(a.u);
+    }
+
+    template <typename... T> void append(std::string& out, const std::string& spec, T... x)
+    {
+        char buffer[512];
+        int n = std::snprintf(buffer, sizeof buffer, spec.c_str(), x...);
+        if (n < 0)
+            return;
+        if (std::size_t(n) < sizeof buffer)
+            out.append(buffer, std::size_t(n));
+        else
+        {
+            std::vector<char> big(std::size_t(n) + 1);
+            std::snprintf(big.data(), big.size(), spec.c_str(), x...);
+            out.append(big.data(), std::size_t(n));
+        }
+    }
+
+    // formats the arguments at p, of the given types, with a printf format; each conversion
+    // takes the next argument whatever its type, converting it as needed, so a format that
+    // does not match the call still prints something sensible. Returns false when the
+    // arguments run past end.
+    inline bool render(std::string_view format, std::string_view codes, const char*& p, const char* end,
+                       std::string& out)
+    {
+        std::vector<arg> args(codes.size());
+        for (std::size_t k = 0; k < codes.size(); k++)
+        {
+            if (!read_arg(codes[k], p, end, args[k]))
+                return false;
+        }
+
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < format.size(); )
+        {
+            if (format[i] != '%')
+            {
+                out += format[i++];
+                continue;
+            }
+            std::size_t start = i++;
+            std::string spec  = "%";
+            while (i < format.size() && std::strchr("-+ #0", format[i]))
+                spec += format[i++];
+            // width and precision, from the arguments when given as *
+            for (int part = 0; part < 2; part++)
+            {
+                if (part == 1)
+                {
+                    if (i >= format.size() || format[i] != '.')
+                        break;
+                    spec += format[i++];
+                }
+                if (i < format.size() && format[i] == '*')
+                {
+                    i++;
+                    spec += std::to_string(next < args.size() ? as_signed(args[next++]) : 0);
+                }
+                while (i < format.size() && format[i] >= '0' && format[i] <= '9')
+                    spec += format[i++];
+            }
+            while (i < format.size() && std::strchr("hlLqjzt", format[i]))
+                i++;
+            if (i >= format.size())
+            {
+                out.append(format.substr(start));
+                break;
+            }
+            char conversion = format[i++];
+            if (conversion == '%')
+            {
+                out += '%';
+                continue;
+            }
+            if (!std::strchr("diouxXcfFeEgGaAsp", conversion) || next >= args.size())
+            {
+                out.append(format.substr(start, i - start));
+                continue;
+            }
+
+            const arg& a = args[next++];
+            if (a.code == 's' && conversion != 's')
+                append(out, spec + "s", std::string(a.s).c_str());
+            else if (conversion == 's')
+            {
+                if (a.code == 's' && spec.find('.') == std::string::npos)
+                    append(out, spec + ".*s", int(a.s.size()), a.s.data());
+                else if (a.code == 's')
+                    append(out, spec + "s", std::string(a.s).c_str());
+                else if (a.code == 'd')
+                    append(out, spec + "g", a.d);
+                else if (is_signed(a))
+                    append(out, spec + "lld", a.i);
+                else
+                    append(out, spec + "llu", a.u);
+            }
+            else if (conversion == 'd' || conversion == 'i')
+                append(out, spec + "lld", as_signed(a));
+            else if (std::strchr("ouxX", conversion))
+                append(out, spec + "ll" + conversion, as_unsigned(a));
+            else if (conversion == 'c')
+                append(out, spec + "c", int(as_signed(a)));
+            else if (conversion == 'p')
+                append(out, spec + "p", reinterpret_cast<void*>(std::uintptr_t(as_unsigned(a))));
+            else
+                append(out, spec + conversion, as_double(a));
+        }
+        return true;
+    }
+
+    // LOG_BINARY(): Key is the lambda that makes every call site an instance of its own
+    template <typename Key, typename... A> void write(Key, const char* file, unsigned line, const char* format,
+                                                      const A&... args)
+    {
+        // so that a record always fits in a ring
+        static_assert(sizeof...(A) <= 32, "LOG_BINARY: at most 32 arguments");
+        static const std::uint32_t id = register_site(format, file, line, signature<A...>::codes);
+
+        if (binary_running())
+        {
+            std::uint64_t now   = steady_ns();
+            std::uint16_t bytes = std::uint16_t((std::size_t(0) + ... + stored_size(store(args))));
+            log_detail::ring& r = log_detail::local_ring();
+            std::uint64_t at;
+            if (!log_detail::reserve(r, 1 + sizeof id + sizeof now + sizeof bytes + bytes, at))
+                return;
+            ring_out out = { r, at };
+            put(out, 'r');
+            put(out, id);
+            put(out, now);
+            put(out, bytes);
+            (put(out, store(args)), ...);
+            log_detail::commit(r, out.at);
+            return;
+        }
+
+        // no binary log: the same encoding, rendered right away
+        std::string bytes, line_text;
+        [[maybe_unused]] string_out out = { bytes };
+        (put(out, store(args)), ...);
+        const char* p = bytes.data();
+        render(format, signature<A...>::codes, p, p + bytes.size(), line_text);
+        if (!log_push({ line_text, "\n" }))
+        {
+            line_text += '\n';
+            std::fwrite(line_text.data(), 1, line_text.size(), stdout);
+        }
+    }
+}
+
+namespace binlog_detail
+{
+    // what a binary log file starts with: the header, then every call site known so far
+    inline std::string prologue(const site_table& t)
+    {
+        std::string header("BLOG");
+        string_out out = { header };
+        put(out, version);
+        put(out, system_ns());
+        put(out, steady_ns());
+        for (std::size_t i = 0; i < t.sites.size(); i++)
+            header += describe(std::uint32_t(i), t.sites[i]);
+        return header;
+    }
+}
+
+// starts a binary log into sink; a sink that starts new files, as mmap_sink does, repeats the
+// header and the call sites at the top of each, so that every file decodes on its own. Throws
+// std::logic_error when the logger is already running
+inline void binary_log_start(std::unique_ptr<log_sink> sink)
+{
+    using namespace binlog_detail;
+
+    // before the prologue goes into the sink
+    if (log_running())
+        throw std::logic_error("binary_log_start: the logger is already running");
+    site_table& t = sites();
+    std::size_t known;
+    {
+        std::lock_guard<std::mutex> hold(t.lock);
+        known = t.sites.size();
+        sink->set_prologue(prologue(t), []()
+        {
+            site_table& t = sites();
+            std::lock_guard<std::mutex> hold(t.lock);
+            return prologue(t);
+        });
+    }
+    log_detail::start(std::move(sink), true);
+
+    // sites registered before the logger ran are in neither the header nor a record of their
+    // own; some registered after may be described twice, which decoders allow
+    std::vector<std::string> records;
+    {
+        std::lock_guard<std::mutex> hold(t.lock);
+        for (std::size_t i = known; i < t.sites.size(); i++)
+            records.push_back(describe(std::uint32_t(i), t.sites[i]));
+    }
+    log_detail::ring& r = log_detail::local_ring();
+    for (std::size_t i = 0; i < records.size(); i++)
+    {
+        std::uint64_t at;
+        if (!log_detail::reserve(r, records[i].size(), at))
+            return;
+        r.copy_in(at, records[i].data(), records[i].size());
+        log_detail::commit(r, at + records[i].size());
+    }
+}
+
+// opens path for a binary log and starts the logger; throws std::runtime_error when the file
+// cannot be opened, std::logic_error when the logger is already running
+inline void binary_log_start(const char* path)
+{
+    // before the file is opened, and truncated
+    if (log_running())
+        throw std::logic_error("binary_log_start: the logger is already running");
+    binary_log_start(std::unique_ptr<log_sink>(new file_sink(path, true)));
+}
+
+// every call site gets its own lambda type, so its own instance of write() and its own id
+#define LOG_BINARY(...) binlog_detail::write([]() {}, __FILE__, __LINE__, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef BULK_ARITH_H
+#define BULK_ARITH_H
+
+#include <climits>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BULK_ARITH_X86 1
+#endif
+
+/**
+ * Elementwise int arithmetic over arrays, the array forms of Multiply(), X() and addition():
+ *
+ *  add(a, b, out, n, mode)         out[i] = a[i] + b[i]
+ *  multiply(a, b, out, n, mode)    out[i] = a[i] * b[i]
+ *
+ * overflow_wrap wraps around like unsigned arithmetic, overflow_saturate clamps to INT_MIN or
+ * INT_MAX, and overflow_checked throws std::overflow_error naming the first element that
+ * overflows; the elements before it may already have been written. out may be a or b.
+ *
+ * The kernels are compiled for AVX-512, AVX2 and plain C++ in the same binary, and the first
+ * call picks one for active_cpu_level() (cpu_dispatch.h).
+ */
+
+enum overflow_mode { overflow_wrap, overflow_saturate, overflow_checked };
+
+namespace bulk_detail
+{
+    inline int add_wrap(int a, int b)       { return int(unsigned(a) + unsigned(b)); }
+    inline int multiply_wrap(int a, int b)  { return int(unsigned(a) * unsigned(b)); }
+
+    inline int add_saturate(int a, int b)
+    {
+        int r;
+        if (__builtin_add_overflow(a, b, &r))
+            return a < 0 ? INT_MIN : INT_MAX;
+        return r;
+    }
+
+    inline int multiply_saturate(int a, int b)
+    {
+        int r;
+        if (__builtin_mul_overflow(a, b, &r))
+            return (a < 0) != (b < 0) ? INT_MIN : INT_MAX;
+        return r;
+    }
+
+    // one instruction set: the add and multiply kernels, and whether a block would overflow
+    struct scalar_isa
+    {
+        static void add(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            for (std::size_t i = 0; i < n; i++)
+                out[i] = saturate ? add_saturate(a[i], b[i]) : add_wrap(a[i], b[i]);
+        }
+        static void multiply(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            for (std::size_t i = 0; i < n; i++)
+                out[i] = saturate ? multiply_saturate(a[i], b[i]) : multiply_wrap(a[i], b[i]);
+        }
+        static bool add_overflows(const int* a, const int* b, std::size_t n)
+        {
+            bool any = false;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                int r;
+                any |= __builtin_add_overflow(a[i], b[i], &r);
+            }
+            return any;
+        }
+        static bool multiply_overflows(const int* a, const int* b, std::size_t n)
+        {
+            bool any = false;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                int r;
+                any |= __builtin_mul_overflow(a[i], b[i], &r);
+            }
+            return any;
+        }
+    };
+
+#if defined(BULK_ARITH_X86)
+    // a + b overflows when the sum has neither sign of the operands; the saturated value then
+    // has the sign of a. a * b overflows when the high half of the 64-bit product is not the
+    // sign extension of the low half; the saturated value has the sign of a ^ b.
+    struct avx2_isa
+    {
+        __attribute__((target("avx2"))) static __m256i add_overflow(__m256i x, __m256i y, __m256i s)
+        {
+            return _mm256_and_si256(_mm256_xor_si256(x, s), _mm256_xor_si256(y, s));
+        }
+
+        // the high halves of the eight 64-bit products
+        __attribute__((target("avx2"))) static __m256i product_high(__m256i x, __m256i y)
+        {
+            __m256i even = _mm256_mul_epi32(x, y);
+            __m256i odd  = _mm256_mul_epi32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(y, 32));
+            return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+        }
+
+        __attribute__((target("avx2"))) static void add(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            __m256i max = _mm256_set1_epi32(INT_MAX);
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                __m256i s = _mm256_add_epi32(x, y);
+                if (saturate)
+                {
+                    __m256i clamp = _mm256_xor_si256(_mm256_srai_epi32(x, 31), max);
+                    s = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(s), _mm256_castsi256_ps(clamp),
+                                                             _mm256_castsi256_ps(add_overflow(x, y, s))));
+                }
+                _mm256_storeu_si256((__m256i*)(out + i), s);
+            }
+            scalar_isa::add(a + i, b + i, out + i, n - i, saturate);
+        }
+
+        __attribute__((target("avx2"))) static void multiply(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            __m256i max = _mm256_set1_epi32(INT_MAX);
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                __m256i p = _mm256_mullo_epi32(x, y);
+                if (saturate)
+                {
+                    __m256i fits  = _mm256_cmpeq_epi32(product_high(x, y), _mm256_srai_epi32(p, 31));
+                    __m256i clamp = _mm256_xor_si256(_mm256_srai_epi32(_mm256_xor_si256(x, y), 31), max);
+                    p = _mm256_blendv_epi8(clamp, p, fits);
+                }
+                _mm256_storeu_si256((__m256i*)(out + i), p);
+            }
+            scalar_isa::multiply(a + i, b + i, out + i, n - i, saturate);
+        }
+
+        __attribute__((target("avx2"))) static bool add_overflows(const int* a, const int* b, std::size_t n)
+        {
+            __m256i any = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                any = _mm256_or_si256(any, add_overflow(x, y, _mm256_add_epi32(x, y)));
+            }
+            return _mm256_movemask_ps(_mm256_castsi256_ps(any)) != 0 || scalar_isa::add_overflows(a + i, b + i, n - i);
+        }
+
+        __attribute__((target("avx2"))) static bool multiply_overflows(const int* a, const int* b, std::size_t n)
+        {
+            __m256i any = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                __m256i p = _mm256_mullo_epi32(x, y);
+                any = _mm256_or_si256(any, _mm256_xor_si256(product_high(x, y), _mm256_srai_epi32(p, 31)));
+            }
+            return !_mm256_testz_si256(any, any) || scalar_isa::multiply_overflows(a + i, b + i, n - i);
+        }
+    };
+
+    // the same with sixteen lanes, and masked loads and stores for the tail. GCC 12 warns about
+    // the _mm512_undefined_epi32() inside its own intrinsics (GCC bug 105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    struct avx512_isa
+    {
+        __attribute__((target("avx512f"))) static __mmask16 tail(std::size_t left)
+        {
+            return left >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << left) - 1);
+        }
+
+        __attribute__((target("avx512f"))) static __mmask16 add_overflow(__m512i x, __m512i y, __m512i s)
+        {
+            __m512i o = _mm512_and_si512(_mm512_xor_si512(x, s), _mm512_xor_si512(y, s));
+            return _mm512_cmplt_epi32_mask(o, _mm512_setzero_si512());
+        }
+
+        __attribute__((target("avx512f"))) static __mmask16 multiply_overflow(__m512i x, __m512i y, __m512i p)
+        {
+            __m512i even = _mm512_mul_epi32(x, y);
+            __m512i odd  = _mm512_mul_epi32(_mm512_srli_epi64(x, 32), _mm512_srli_epi64(y, 32));
+            __m512i high = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+            return _mm512_cmpneq_epi32_mask(high, _mm512_srai_epi32(p, 31));
+        }
+
+        __attribute__((target("avx512f"))) static void add(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            __m512i max = _mm512_set1_epi32(INT_MAX);
+            for (std::size_t i = 0; i < n; i += 16)
+            {
+                __mmask16 m = tail(n - i);
+                __m512i x = _mm512_maskz_loadu_epi32(m, a + i);
+                __m512i y = _mm512_maskz_loadu_epi32(m, b + i);
+                __m512i s = _mm512_add_epi32(x, y);
+                if (saturate)
+                    s = _mm512_mask_mov_epi32(s, add_overflow(x, y, s), _mm512_xor_si512(_mm512_srai_epi32(x, 31), max));
+                _mm512_mask_storeu_epi32(out + i, m, s);
+            }
+        }
+
+        __attribute__((target("avx512f"))) static void multiply(const int* a, const int* b, int* out, std::size_t n, bool saturate)
+        {
+            __m512i max = _mm512_set1_epi32(INT_MAX);
+            for (std::size_t i = 0; i < n; i += 16)
+            {
+                __mmask16 m = tail(n - i);
+                __m512i x = _mm512_maskz_loadu_epi32(m, a + i);
+                __m512i y = _mm512_maskz_loadu_epi32(m, b + i);
+                __m512i p = _mm512_mullo_epi32(x, y);
+                if (saturate)
+                    p = _mm512_mask_mov_epi32(p, multiply_overflow(x, y, p),
+                                              _mm512_xor_si512(_mm512_srai_epi32(_mm512_xor_si512(x, y), 31), max));
+                _mm512_mask_storeu_epi32(out + i, m, p);
+            }
+        }
+
+        __attribute__((target("avx512f"))) static bool add_overflows(const int* a, const int* b, std::size_t n)
+        {
+            __mmask16 any = 0;
+            for (std::size_t i = 0; i < n; i += 16)
+            {
+                __mmask16 m = tail(n - i);
+                __m512i x = _mm512_maskz_loadu_epi32(m, a + i);
+                __m512i y = _mm512_maskz_loadu_epi32(m, b + i);
+                any |= add_overflow(x, y, _mm512_add_epi32(x, y));
+            }
+            return any != 0;
+        }
+
+        __attribute__((target("avx512f"))) static bool multiply_overflows(const int* a, const int* b, std::size_t n)
+        {
+            __mmask16 any = 0;
+            for (std::size_t i = 0; i < n; i += 16)
+            {
+                __mmask16 m = tail(n - i);
+                __m512i x = _mm512_maskz_loadu_epi32(m, a + i);
+                __m512i y = _mm512_maskz_loadu_epi32(m, b + i);
+                any |= multiply_overflow(x, y, _mm512_mullo_epi32(x, y));
+            }
+            return any != 0;
+        }
+    };
+#pragma GCC diagnostic pop
+#endif
+
+    struct kernels
+    {
+        void (*add)(const int*, const int*, int*, std::size_t, bool);
+        void (*multiply)(const int*, const int*, int*, std::size_t, bool);
+        bool (*add_overflows)(const int*, const int*, std::size_t);
+        bool (*multiply_overflows)(const int*, const int*, std::size_t);
+    };
+
+    template <typename Isa> kernels bind()
+    {
+        kernels k = { Isa::add, Isa::multiply, Isa::add_overflows, Isa::multiply_overflows };
+        return k;
+    }
+
+    inline const kernels& pick()
+    {
+#if defined(BULK_ARITH_X86)
+        static const kernels k = select_kernel<kernels (*)()>(bind<scalar_isa>, 0, bind<avx2_isa>, bind<avx512_isa>)();
+#else
+        static const kernels k = bind<scalar_isa>();
+#endif
+        return k;
+    }
+
+    // overflow_checked: every block is checked before it is written, so that out may be a or b
+    // and the element named by the exception still has its inputs
+    const std::size_t checked_block = 1024;
+
+    template <typename Op>
+    void checked(const char* name, Op op, const int* a, const int* b, int* out, std::size_t n,
+                 bool (*overflows)(const int*, const int*, std::size_t),
+                 void (*kernel)(const int*, const int*, int*, std::size_t, bool))
+    {
+        for (std::size_t i = 0; i < n; i += checked_block)
+        {
+            std::size_t len = n - i < checked_block ? n - i : checked_block;
+            if (overflows(a + i, b + i, len))
+            {
+                for (std::size_t j = i; j < i + len; j++)
+                {
+                    int r;
+                    if (op(a[j], b[j], &r))
+                        throw std::overflow_error(std::string(name) + ": overflow at element " + std::to_string(j));
+                }
+            }
+            kernel(a + i, b + i, out + i, len, false);
+        }
+    }
+}
+
+inline void add(const int* a, const int* b, int* out, std::size_t n, overflow_mode mode = overflow_wrap)
+{
+    const bulk_detail::kernels& k = bulk_detail::pick();
+    if (mode == overflow_checked)
+        bulk_detail::checked("add", [](int x, int y, int* r) { return __builtin_add_overflow(x, y, r); },
+                             a, b, out, n, k.add_overflows, k.add);
+    else
+        k.add(a, b, out, n, mode == overflow_saturate);
+}
+
+inline void multiply(const int* a, const int* b, int* out, std::size_t n, overflow_mode mode = overflow_wrap)
+{
+    const bulk_detail::kernels& k = bulk_detail::pick();
+    if (mode == overflow_checked)
+        bulk_detail::checked("multiply", [](int x, int y, int* r) { return __builtin_mul_overflow(x, y, r); },
+                             a, b, out, n, k.multiply_overflows, k.multiply);
+    else
+        k.multiply(a, b, out, n, mode == overflow_saturate);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_DISPATCH_X86 1
+#endif
+
+/**
+ * Which instruction set the numeric kernels run with. The SIMD kernels of prefix_scan.h,
+ * scan_ops.h, bulk_arith.h, prime_sieve.h and 03_Brain/reductions.cpp are compiled for every
+ * level in the same binary (with target attributes, no -m flags needed), and each picks its
+ * variant on first use:
+ *
+ *  cpu_scalar      plain C++
+ *  cpu_sse42       SSE4.2 and POPCNT
+ *  cpu_avx2        AVX2
+ *  cpu_avx512      AVX-512F
+ *
+ * active_cpu_level() is the best level the CPU supports, or the level named by the environment
+ * variable CPU_LEVEL (scalar, sse4.2, avx2 or avx512) when that is lower, to test the narrower
+ * kernels on a wide machine. A level the CPU does not support is never used, and an unknown
+ * name leaves the detected level with a warning on stderr.
+ */
+
+enum cpu_level { cpu_scalar, cpu_sse42, cpu_avx2, cpu_avx512 };
+
+inline const char* cpu_level_name(cpu_level level)
+{
+    static const char* const names[] = { "scalar", "sse4.2", "avx2", "avx512" };
+    return names[level];
+}
+
+namespace dispatch_detail
+{
+    inline cpu_level detect()
+    {
+#if defined(CPU_DISPATCH_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2"))
+            return cpu_avx512;
+        if (__builtin_cpu_supports("avx2"))
+            return cpu_avx2;
+        if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+            return cpu_sse42;
+#endif
+        return cpu_scalar;
+    }
+
+    inline cpu_level from_environment(cpu_level supported)
+    {
+        const char* name = std::getenv("CPU_LEVEL");
+        if (name == 0 || *name == 0)
+            return supported;
+        for (int level = cpu_scalar; level <= cpu_avx512; level++)
+        {
+            if (std::strcmp(name, cpu_level_name(cpu_level(level))) == 0)
+                return level < supported ? cpu_level(level) : supported;
+        }
+        // read on the first kernel call, which may be deep in a computation or before main():
+        // a warning rather than an exception
+        std::fprintf(stderr, "CPU_LEVEL: unknown level %s, using %s\n", name, cpu_level_name(supported));
+        return supported;
+    }
+}
+
+// detected once, on the first call
+inline cpu_level active_cpu_level()
+{
+    static const cpu_level level = dispatch_detail::from_environment(dispatch_detail::detect());
+    return level;
+}
+
+// the variant for the active level; a null variant falls back to the next level down, and the
+// scalar one must be given
+template <typename F> F select_kernel(F scalar, F sse42, F avx2, F avx512)
+{
+    F by_level[] = { scalar, sse42, avx2, avx512 };
+    for (int level = active_cpu_level(); level > cpu_scalar; level--)
+    {
+        if (by_level[level])
+            return by_level[level];
+    }
+    return scalar;
+}
+
+#endif
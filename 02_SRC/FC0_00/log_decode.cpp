@@ -0,0 +1,200 @@
+/**
+ * log_decode.cpp: prints a binary log written by binary_log_start() as text. Every LOG_BINARY
+ * record becomes one line with its wall clock time; text records, from Log() and the like, are
+ * printed as they are. It reads the segments of mmap_sink too, compressed or not.
+ *
+ *      g++ -std=c++17 -O2 -pthread log_decode.cpp -o log_decode -lz
+ *      ./log_decode [-s] app.blog > app.log
+ *
+ * -s adds the file and line of the call site to every line.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "binary_log.h"
+
+using namespace std;
+using namespace binlog_detail;
+
+struct reader
+{
+    const char* p;
+    const char* end;
+
+    template <typename T> bool get(T& x)        { return take(p, end, x); }
+    bool get(string& s, size_t n)
+    {
+        if (size_t(end - p) < n)
+            return false;
+        s.assign(p, n);
+        p += n;
+        return true;
+    }
+    bool skip(size_t n)
+    {
+        if (size_t(end - p) < n)
+            return false;
+        p += n;
+        return true;
+    }
+};
+
+// the whole file; zlib reads a gzip file, as mmap_sink leaves its closed segments, and passes
+// any other through
+bool read_file(const char* path, vector<char>& data)
+{
+    gzFile f = gzopen(path, "rb");
+    if (!f)
+        return false;
+    char buffer[1 << 16];
+    int n;
+    while ((n = gzread(f, buffer, sizeof buffer)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    return gzclose(f) == Z_OK && n == 0;
+}
+
+// a segment that mmap_sink did not get to close is zeros after its last record
+bool unwritten(const char* p, const char* end)
+{
+    for (; p < end; p++)
+    {
+        if (*p)
+            return false;
+    }
+    return true;
+}
+
+// walks the records after the header; on_site and on_record see every 'S' and 'r' record,
+// on_text every 't' one. Returns false, with the offset in bad, when the file is cut short
+// or holds something else.
+template <typename Site, typename Record, typename Text>
+bool walk(const vector<char>& data, size_t start, Site on_site, Record on_record, Text on_text, size_t& bad)
+{
+    reader in = { data.data() + start, data.data() + data.size() };
+    while (in.p < in.end)
+    {
+        bad = size_t(in.p - data.data());
+        char kind;
+        in.get(kind);
+        if (kind == 0 && unwritten(in.p, in.end))
+            return true;
+        if (kind == 'S')
+        {
+            uint32_t id, line;
+            uint16_t size;
+            uint8_t count;
+            site s;
+            if (!in.get(id) || !in.get(line) || !in.get(size) || !in.get(s.file, size) || !in.get(size) ||
+                !in.get(s.format, size) || !in.get(count) || !in.get(s.codes, count))
+                return false;
+            s.line = line;
+            on_site(id, s);
+        }
+        else if (kind == 'r')
+        {
+            uint32_t id;
+            uint64_t time;
+            uint16_t size;
+            if (!in.get(id) || !in.get(time) || !in.get(size) || size_t(in.end - in.p) < size)
+                return false;
+            on_record(id, time, in.p, in.p + size);
+            in.p += size;
+        }
+        else if (kind == 't')
+        {
+            uint32_t size;
+            if (!in.get(size) || size_t(in.end - in.p) < size)
+                return false;
+            on_text(in.p, size);
+            in.p += size;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool sites_too = argc > 2 && strcmp(argv[1], "-s") == 0;
+    if (argc != 2 + sites_too)
+    {
+        fprintf(stderr, "usage: %s [-s] file\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[1 + sites_too];
+
+    vector<char> data;
+    if (!read_file(path, data))
+    {
+        fprintf(stderr, "%s: cannot read %s\n", argv[0], path);
+        return 1;
+    }
+    // the next segment, made ahead of time by a program that then died
+    if (unwritten(data.data(), data.data() + data.size()))
+        return 0;
+    reader head = { data.data(), data.data() + data.size() };
+    string magic;
+    uint32_t file_version;
+    uint64_t system_start, steady_start;
+    if (!head.get(magic, 4) || magic != "BLOG" || !head.get(file_version) || !head.get(system_start) ||
+        !head.get(steady_start))
+    {
+        fprintf(stderr, "%s: %s is not a binary log\n", argv[0], path);
+        return 1;
+    }
+    if (file_version != version)
+    {
+        fprintf(stderr, "%s: %s is version %u, this decoder reads version %u\n", argv[0], path, file_version, version);
+        return 1;
+    }
+    size_t start = size_t(head.p - data.data());
+
+    // pass 1: the call sites
+    map<uint32_t, site> sites;
+    size_t bad = 0;
+    bool whole = walk(data, start, [&](uint32_t id, const site& s) { sites[id] = s; },
+                      [](uint32_t, uint64_t, const char*, const char*) {}, [](const char*, size_t) {}, bad);
+
+    // pass 2: the records, in file order
+    string line;
+    walk(data, start, [](uint32_t, const site&) {},
+         [&](uint32_t id, uint64_t time, const char* p, const char* end)
+         {
+             line.clear();
+             uint64_t ns   = system_start + (time - steady_start);
+             time_t   secs = time_t(ns / 1000000000);
+             struct tm local;
+             localtime_r(&secs, &local);
+             char stamp[64];
+             size_t n = strftime(stamp, sizeof stamp, "%Y-%m-%d %H:%M:%S", &local);
+             snprintf(stamp + n, sizeof stamp - n, ".%06u  ", unsigned(ns % 1000000000 / 1000));
+             line += stamp;
+
+             map<uint32_t, site>::const_iterator s = sites.find(id);
+             if (s == sites.end())
+                 line += "(unknown call site " + to_string(id) + ")";
+             else
+             {
+                 if (sites_too)
+                     line += s->second.file + ":" + to_string(s->second.line) + "  ";
+                 if (!render(s->second.format, s->second.codes, p, end, line))
+                     line += " (arguments cut short)";
+             }
+             line += '\n';
+             fwrite(line.data(), 1, line.size(), stdout);
+         },
+         [](const char* text, size_t size) { fwrite(text, 1, size, stdout); }, bad);
+
+    if (!whole)
+    {
+        fprintf(stderr, "%s: %s is cut short or damaged at byte %zu\n", argv[0], path, bad);
+        return 1;
+    }
+    return 0;
+}
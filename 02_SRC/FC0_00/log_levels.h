@@ -0,0 +1,362 @@
+#ifndef LOG_LEVELS_H
+#define LOG_LEVELS_H
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "async_log.h"
+
+/**
+ * Leveled logging by category, with key/value fields:
+ *
+ *      log_category net("net");
+ *      LOG_DEBUG(net, "connected", kv("peer", address), kv("ms", elapsed));
+ *
+ * writes the line
+ *
+ *      level=debug cat=net msg=connected peer=10.0.0.7 ms=12
+ *
+ * through log_push(), or to stdout when the logger is not running. Values are integers, bool,
+ * floating point or strings; a string with a space, '=', '"' or a control character in it is
+ * quoted, with '"' and '\\' escaped and control characters written as \n, \r, \t or \xHH.
+ *
+ * Two filters, both before any argument is evaluated:
+ *
+ *  LOG_COMPILED_LEVEL  the lowest level compiled in, a number 0 (trace) to 6 (off), 0 unless
+ *                      defined; LOG_TRACE(...) under -DLOG_COMPILED_LEVEL=2 is no code at all
+ *  a category's level  set at run time, and checked with one relaxed atomic load; info unless
+ *                      the environment variable LOG_LEVELS or log_set_level() says otherwise
+ *
+ * LOG_LEVELS is a comma separated list of levels, each for one category (net=debug) or, without
+ * a name, for every category (warn,net=trace). The level names are trace, debug, info, warn,
+ * error, fatal and off; an entry with an unknown one is skipped, with a warning on stderr.
+ *
+ * Categories are registered when they are built and should live as long as the program, as
+ * globals or function statics.
+ */
+
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+enum log_level { log_trace, log_debug, log_info, log_warn, log_error, log_fatal, log_off };
+
+const log_level log_compiled_level = log_level(LOG_COMPILED_LEVEL);
+
+static_assert(log_compiled_level >= log_trace && log_compiled_level <= log_off,
+              "LOG_COMPILED_LEVEL must be 0 (trace) to 6 (off)");
+
+inline const char* log_level_name(log_level level)
+{
+    static const char* const names[] = { "trace", "debug", "info", "warn", "error", "fatal", "off" };
+    return names[level];
+}
+
+class log_category
+{
+public:
+    explicit log_category(const char* name);
+    ~log_category();
+    log_category(const log_category&) = delete;
+    log_category& operator=(const log_category&) = delete;
+
+    const char* name() const                { return title; }
+    log_level level() const                 { return log_level(threshold.load(std::memory_order_relaxed)); }
+    bool enabled(log_level level) const     { return int(level) >= threshold.load(std::memory_order_relaxed); }
+
+private:
+    friend void log_set_level(const char* name, log_level level);
+    friend void log_set_level(log_level level);
+
+    const char*         title;
+    std::atomic<int>    threshold;
+};
+
+// one key/value field of a line; kv() makes one from an integer, bool, floating point or string
+struct log_field
+{
+    enum kind { integer, unsigned_integer, boolean, floating, text };
+
+    std::string_view    key;
+    kind                type;
+    union
+    {
+        std::int64_t    i;
+        std::uint64_t   u;
+        bool            b;
+        double          d;
+    };
+    std::string_view    s;
+};
+
+inline log_field kv(std::string_view key, bool x)                { log_field f; f.key = key; f.type = log_field::boolean; f.b = x; return f; }
+inline log_field kv(std::string_view key, int x)                 { log_field f; f.key = key; f.type = log_field::integer; f.i = x; return f; }
+inline log_field kv(std::string_view key, long x)                { log_field f; f.key = key; f.type = log_field::integer; f.i = x; return f; }
+inline log_field kv(std::string_view key, long long x)           { log_field f; f.key = key; f.type = log_field::integer; f.i = x; return f; }
+inline log_field kv(std::string_view key, unsigned x)            { log_field f; f.key = key; f.type = log_field::unsigned_integer; f.u = x; return f; }
+inline log_field kv(std::string_view key, unsigned long x)       { log_field f; f.key = key; f.type = log_field::unsigned_integer; f.u = x; return f; }
+inline log_field kv(std::string_view key, unsigned long long x)  { log_field f; f.key = key; f.type = log_field::unsigned_integer; f.u = x; return f; }
+inline log_field kv(std::string_view key, double x)              { log_field f; f.key = key; f.type = log_field::floating; f.d = x; return f; }
+inline log_field kv(std::string_view key, const char* x)         { log_field f; f.key = key; f.type = log_field::text; f.u = 0; f.s = x ? x : "(null)"; return f; }
+inline log_field kv(std::string_view key, const std::string& x)  { log_field f; f.key = key; f.type = log_field::text; f.u = 0; f.s = x; return f; }
+inline log_field kv(std::string_view key, std::string_view x)    { log_field f; f.key = key; f.type = log_field::text; f.u = 0; f.s = x; return f; }
+
+namespace level_detail
+{
+    // the levels asked for, by category name; an empty name is every category
+    struct rule
+    {
+        std::string name;
+        log_level   level;
+    };
+
+    struct registry
+    {
+        std::mutex                  lock;
+        std::vector<log_category*>  categories;
+        std::vector<rule>           rules;
+    };
+
+    inline bool parse_level(std::string_view name, log_level& level)
+    {
+        for (int l = log_trace; l <= log_off; l++)
+        {
+            if (name == log_level_name(log_level(l)))
+            {
+                level = log_level(l);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline std::vector<rule> from_environment()
+    {
+        std::vector<rule> rules;
+        const char* spec = std::getenv("LOG_LEVELS");
+        std::string_view rest = spec ? spec : "";
+        while (!rest.empty())
+        {
+            std::size_t comma     = rest.find(',');
+            std::string_view item = rest.substr(0, comma);
+            rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+            if (item.empty())
+                continue;
+            std::size_t equals = item.find('=');
+            rule r;
+            if (equals != std::string_view::npos)
+                r.name = std::string(item.substr(0, equals));
+            std::string_view name = equals == std::string_view::npos ? item : item.substr(equals + 1);
+            // read while the first category is built, often before main(): a typo must not end
+            // the program
+            if (!parse_level(name, r.level))
+            {
+                std::fprintf(stderr, "LOG_LEVELS: unknown level %.*s, %.*s ignored\n", int(name.size()),
+                             name.data(), int(item.size()), item.data());
+                continue;
+            }
+            rules.push_back(r);
+        }
+        return rules;
+    }
+
+    inline registry& state()
+    {
+        static registry r = { {}, {}, from_environment() };
+        return r;
+    }
+
+    // the last rule that names the category, or the last one for every category
+    inline log_level level_for(const registry& r, const char* name)
+    {
+        log_level level = log_info;
+        for (std::size_t i = 0; i < r.rules.size(); i++)
+        {
+            if (r.rules[i].name.empty() || r.rules[i].name == name)
+                level = r.rules[i].level;
+        }
+        return level;
+    }
+
+    inline bool needs_quotes(std::string_view s)
+    {
+        if (s.empty())
+            return true;
+        for (char c : s)
+        {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (u <= ' ' || u == 0x7f || c == '=' || c == '"' || c == '\\')
+                return true;
+        }
+        return false;
+    }
+
+    inline void append_text(std::string& out, std::string_view s)
+    {
+        if (!needs_quotes(s))
+        {
+            out += s;
+            return;
+        }
+        out += '"';
+        static const char hex[] = "0123456789abcdef";
+        for (char c : s)
+        {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+                out += "\\n";
+            else if (c == '\r')
+                out += "\\r";
+            else if (c == '\t')
+                out += "\\t";
+            else if (u < 0x20 || u == 0x7f)
+            {
+                // one line per record, and nothing a terminal would act on
+                out += "\\x";
+                out += hex[u >> 4];
+                out += hex[u & 15];
+            }
+            else
+                out += c;
+        }
+        out += '"';
+    }
+
+    inline void append(std::string& out, const log_field& f)
+    {
+        out += ' ';
+        out += f.key;
+        out += '=';
+        char number[32];
+        switch (f.type)
+        {
+        case log_field::integer:
+            out.append(number, std::to_chars(number, number + sizeof number, f.i).ptr);
+            break;
+        case log_field::unsigned_integer:
+            out.append(number, std::to_chars(number, number + sizeof number, f.u).ptr);
+            break;
+        case log_field::boolean:
+            out += f.b ? "true" : "false";
+            break;
+        case log_field::floating:
+            // the shortest text that reads back as the same double
+            out.append(number, std::to_chars(number, number + sizeof number, f.d).ptr);
+            break;
+        case log_field::text:
+            append_text(out, f.s);
+            break;
+        }
+    }
+
+    // formats the line on the calling thread, into a buffer that is kept between calls
+    template <typename... F>
+    void write(log_level level, const log_category& category, std::string_view message, const F&... fields)
+    {
+        thread_local std::string line;
+        line.clear();
+        line += "level=";
+        line += log_level_name(level);
+        line += " cat=";
+        append_text(line, category.name());
+        line += " msg=";
+        append_text(line, message);
+        (append(line, fields), ...);
+        line += '\n';
+        if (!log_push({ line }))
+            std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+}
+
+inline log_category::log_category(const char* name) : title(name), threshold(log_info)
+{
+    level_detail::registry& r = level_detail::state();
+    std::lock_guard<std::mutex> hold(r.lock);
+    threshold.store(level_detail::level_for(r, name), std::memory_order_relaxed);
+    r.categories.push_back(this);
+}
+
+inline log_category::~log_category()
+{
+    level_detail::registry& r = level_detail::state();
+    std::lock_guard<std::mutex> hold(r.lock);
+    for (std::size_t i = 0; i < r.categories.size(); i++)
+    {
+        if (r.categories[i] == this)
+        {
+            r.categories[i] = r.categories.back();
+            r.categories.pop_back();
+            break;
+        }
+    }
+}
+
+// the level of every category called name, now and when built later
+inline void log_set_level(const char* name, log_level level)
+{
+    level_detail::registry& r = level_detail::state();
+    std::lock_guard<std::mutex> hold(r.lock);
+    level_detail::rule rule = { name, level };
+    r.rules.push_back(rule);
+    for (std::size_t i = 0; i < r.categories.size(); i++)
+    {
+        if (std::strcmp(r.categories[i]->name(), name) == 0)
+            r.categories[i]->threshold.store(level, std::memory_order_relaxed);
+    }
+}
+
+// the level of every category, replacing what was set before
+inline void log_set_level(log_level level)
+{
+    level_detail::registry& r = level_detail::state();
+    std::lock_guard<std::mutex> hold(r.lock);
+    level_detail::rule rule = { "", level };
+    r.rules.assign(1, rule);
+    for (std::size_t i = 0; i < r.categories.size(); i++)
+        r.categories[i]->threshold.store(level, std::memory_order_relaxed);
+}
+
+// a line at level L in category; nothing at all below LOG_COMPILED_LEVEL, and one relaxed load
+// when the category is quieter than L. The fields are built before the call; the LOG_ macros
+// below skip that too
+template <log_level L, typename... F>
+inline void log_at(const log_category& category, std::string_view message, const F&... fields)
+{
+    if constexpr (L >= log_compiled_level && L < log_off)
+    {
+        if (category.enabled(L))
+            level_detail::write(L, category, message, fields...);
+    }
+}
+
+#define LOG_AT(level, category, ...)                                                        \
+    do                                                                                      \
+    {                                                                                       \
+        if constexpr ((level) >= log_compiled_level && (level) < log_off)                   \
+        {                                                                                   \
+            if ((category).enabled(level))                                                  \
+                level_detail::write((level), (category), __VA_ARGS__);                      \
+        }                                                                                   \
+    } while (0)
+
+#define LOG_TRACE(category, ...)    LOG_AT(log_trace, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...)    LOG_AT(log_debug, category, __VA_ARGS__)
+#define LOG_INFO(category, ...)     LOG_AT(log_info, category, __VA_ARGS__)
+#define LOG_WARN(category, ...)     LOG_AT(log_warn, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...)    LOG_AT(log_error, category, __VA_ARGS__)
+#define LOG_FATAL(category, ...)    LOG_AT(log_fatal, category, __VA_ARGS__)
+
+#endif
@@ -1,43 +1,56 @@
 #include <iostream>
+#include "prefix_scan.h"
+#include "prefix_stream.h"
+#include "scan_ops.h"
+#include "prime_sieve.h"
+#include "numeric_tables.h"
+#include "bulk_arith.h"
 using namespace std;
 
 
+// for arrays see multiply() in bulk_arith.h
 int Multiply(int a, int b)
 {
     int result = a * b;
     return result;
 }
 
+// prints the primes in [min, max] from the compile-time table; j is where the old trial
+// division loop stopped, i + 1
 void surprise(){
-    int max = 1000;
-    int min = 2;
+    const int max = 1000;
+    const int min = 2;
+    static_assert(max <= 1000, "small_primes only goes up to 1000, use for_each_prime()");
     cout << "\n";
-    for(int i = min ; i <= max; i++){
-        int j = 2;
-        while(i%j++ !=0);
-        if(j == i+1) cout << "("<< i<<","<<j<<")= " << i <<"\t" << j << endl;
-
+    for(int i : small_primes){
+        int j = i + 1;
+        if(i >= min && i <= max) cout << "("<< i<<","<<j<<")= " << i <<"\t" << j << endl;
     }
 }
 
 
 void simpson(){
-    double eps = 1.0;
-    while ((1.0 +eps) > 1.0) {
-        eps = eps/2.0;
-    }
-    eps = eps * 2.0;
+    constexpr double eps = machine_epsilon<double>();
     cout.precision(20);
     cout << "eps = " << eps;
 }
 
 
-template <typename T> void sumcum(T* a, T* c, unsigned long n){
-    T temp;
-    c[0] = a[0];
-    for(unsigned long j = 1; j<n ; j ++){
-        c[j] = c[j-1]+a[j];
-    }
+// cumulative sum, see prefix_scan.h for the SIMD and multi-threaded engine
+template <typename T> void sumcum(T* a, T* c, unsigned long n, scan_accuracy accuracy = scan_fast){
+    prefix_sum(a, c, n, accuracy);
+}
+
+// cumulative sum restarted wherever flags[j] != 0, e.g. running balances per account over a
+// log sorted by account (segment_starts() makes the flags), see scan_ops.h for other operators
+template <typename T> void sumcum(T* a, const unsigned char* flags, T* c, unsigned long n){
+    segmented_sum(a, flags, c, n);
+}
+
+// cumulative sum of a binary file of T into another, for series that do not fit in memory;
+// returns the number of elements written, see prefix_stream.h
+template <typename T> unsigned long sumcum(const char* in_path, const char* out_path){
+    return prefix_sum_mapped<T>(in_path, out_path);
 }
 
 void cumulative_sum(){
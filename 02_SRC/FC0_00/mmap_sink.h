@@ -0,0 +1,368 @@
+#ifndef MMAP_SINK_H
+#define MMAP_SINK_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "async_log.h"
+
+/**
+ * A log sink for long-running programs: the log is a series of segment files, path.1, path.2,
+ * ..., each allocated on disk at its full size and mapped into memory, so that writing a batch
+ * is a memcpy with no system call.
+ *
+ *      log_rotation rotation;
+ *      rotation.segment_bytes = 256 << 20;
+ *      rotation.seconds       = 3600;
+ *      rotation.keep          = 48;
+ *      log_start(std::unique_ptr<log_sink>(new mmap_sink("app.log", rotation)));
+ *
+ * A segment is closed when the next batch does not fit in it, or when it is older than
+ * rotation.seconds at the next batch. A background thread has the next segment allocated and
+ * mapped before it is needed, and takes the closed ones: it trims each to the bytes written,
+ * compresses it to path.N.gz with zlib, and removes the oldest once there are more than
+ * rotation.keep. The writer thread of async_log.h only swaps mappings, and the threads calling
+ * log_push() never see any of it. Batches end on record boundaries, and so do segments.
+ *
+ * Numbering goes on from the highest segment already there. A program that dies leaves its
+ * last segment uncompressed and at full size, with zero bytes after the last record, and the
+ * next one all zeros; log_decode reads both. Link with -lz.
+ */
+
+struct log_rotation
+{
+    std::size_t segment_bytes   = std::size_t(64) << 20;    // at least 1 MiB
+    unsigned    seconds         = 0;                        // 0: by size only
+    bool        compress        = true;
+    unsigned    keep            = 0;                        // closed segments kept, 0: all
+};
+
+namespace sink_detail
+{
+    struct segment
+    {
+        std::string                             path;
+        int                                     fd   = -1;
+        char*                                   base = nullptr;
+        std::size_t                             size = 0;
+        std::size_t                             used = 0;
+        std::chrono::steady_clock::time_point   opened;
+    };
+
+    // creates the file at its full size and maps it; false, with nothing left behind, when it
+    // cannot, e.g. when the disk is full
+    inline bool open_segment(segment& s, const std::string& path, std::size_t size)
+    {
+        s      = segment();
+        s.path = path;
+        s.size = size;
+        s.fd   = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (s.fd < 0)
+            return false;
+        // reserved, not sparse, so that a store into the mapping cannot fault on a full disk
+        void* p = MAP_FAILED;
+        if (::posix_fallocate(s.fd, 0, off_t(size)) == 0)
+            p = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(s.fd);
+            ::unlink(path.c_str());
+            s.fd = -1;
+            return false;
+        }
+        s.base = static_cast<char*>(p);
+        // the first store to a page of a shared file mapping faults into the file system; take
+        // those faults here rather than on the writer thread
+        std::size_t page = std::size_t(::sysconf(_SC_PAGESIZE));
+        for (std::size_t at = 0; at < size; at += page)
+            s.base[at] = 0;
+        return true;
+    }
+
+    // unmaps the segment and cuts the file to what was written
+    inline void close_segment(segment& s)
+    {
+        ::munmap(s.base, s.size);
+        while (::ftruncate(s.fd, off_t(s.used)) != 0 && errno == EINTR)
+            ;
+        ::close(s.fd);
+        s.base = nullptr;
+        s.fd   = -1;
+    }
+
+    // path into path.gz, then path removed; false leaves path as it was
+    inline bool compress(const std::string& path)
+    {
+        std::string packed = path + ".gz";
+        std::string part   = packed + ".part";
+        int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            return false;
+        gzFile out = gzopen(part.c_str(), "wb1");
+        bool ok    = out != 0;
+        std::vector<char> buffer(1 << 18);
+        while (ok)
+        {
+            ssize_t n = ::read(in, buffer.data(), buffer.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                ok = n == 0;
+                break;
+            }
+            ok = gzwrite(out, buffer.data(), unsigned(n)) == int(n);
+        }
+        if (out != 0 && gzclose(out) != Z_OK)
+            ok = false;
+        ::close(in);
+        if (ok && std::rename(part.c_str(), packed.c_str()) == 0)
+        {
+            ::unlink(path.c_str());
+            return true;
+        }
+        ::unlink(part.c_str());
+        return false;
+    }
+
+    // the segments of path already on disk, path.N and path.N.gz, oldest first
+    inline std::vector<std::pair<unsigned long, std::string> > existing(const std::string& path)
+    {
+        std::size_t slash = path.rfind('/');
+        std::string dir   = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        std::string name  = (slash == std::string::npos ? path : path.substr(slash + 1)) + ".";
+        std::string head  = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+        std::vector<std::pair<unsigned long, std::string> > found;
+        DIR* d = ::opendir(dir.c_str());
+        if (d == 0)
+            return found;
+        while (dirent* e = ::readdir(d))
+        {
+            const char* entry = e->d_name;
+            if (std::strncmp(entry, name.c_str(), name.size()) != 0)
+                continue;
+            const char* digits = entry + name.size();
+            char* end;
+            unsigned long n = std::strtoul(digits, &end, 10);
+            if (*digits >= '0' && *digits <= '9' && (*end == 0 || std::strcmp(end, ".gz") == 0))
+                found.push_back(std::make_pair(n, head + entry));
+        }
+        ::closedir(d);
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+}
+
+class mmap_sink : public log_sink
+{
+public:
+    // opens the first segment; throws std::runtime_error when it cannot, std::logic_error when
+    // the segments are smaller than 1 MiB
+    explicit mmap_sink(const char* path, log_rotation rotation = log_rotation())
+        : base(path), rules(rotation), prologue_size(0), next(1), want_next(true), have_next(false),
+          stopping(false)
+    {
+        if (rules.segment_bytes < (std::size_t(1) << 20))
+            throw std::logic_error("mmap_sink: segments must be at least 1 MiB");
+        std::vector<std::pair<unsigned long, std::string> > found = sink_detail::existing(base);
+        for (std::size_t i = 0; i < found.size(); i++)
+            closed.push_back(found[i].second);
+        next = found.empty() ? 1 : found.back().first + 1;
+        if (!sink_detail::open_segment(current, name(next++), rules.segment_bytes))
+            throw std::runtime_error("mmap_sink: cannot allocate " + name(next - 1));
+        current.opened = std::chrono::steady_clock::now();
+        worker = std::thread(&mmap_sink::background, this);
+    }
+
+    // closes the last segment and waits until every closed segment is compressed
+    ~mmap_sink()
+    {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            stopping  = true;
+            want_next = false;
+            if (current.base)
+                to_close.push_back(current);
+        }
+        wake.notify_one();
+        worker.join();
+        if (have_next)
+        {
+            sink_detail::close_segment(prepared);
+            ::unlink(prepared.path.c_str());
+        }
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        if (current.base && rules.seconds && current.used > prologue_size &&
+            std::chrono::steady_clock::now() - current.opened >= std::chrono::seconds(rules.seconds))
+            rotate();
+        while (size > 0)
+        {
+            if (!current.base)
+            {
+                rotate();
+                if (!current.base)
+                    return;     // no segment to be had; the batch is lost, as in fd_sink
+            }
+            std::size_t room = current.size - current.used;
+            if (size > room && current.used > prologue_size)
+            {
+                rotate();
+                continue;
+            }
+            if (room == 0)
+                return;         // the prologue fills a whole segment
+            // only a batch larger than a whole segment is split
+            std::size_t n = size < room ? size : room;
+            std::memcpy(current.base + current.used, data, n);
+            current.used += n;
+            data         += n;
+            size         -= n;
+        }
+    }
+
+    void set_prologue(const std::string& now, std::function<std::string()> later)
+    {
+        write(now.data(), now.size());
+        prologue_size = current.used;
+        prologue      = later;
+    }
+
+private:
+    std::string name(unsigned long n) const     { return base + "." + std::to_string(n); }
+
+    // on the writer thread: the prepared segment replaces the current one, which goes to the
+    // background thread to be closed; waits only when segments fill faster than they are made
+    void rotate()
+    {
+        {
+            std::unique_lock<std::mutex> hold(lock);
+            if (!have_next && !want_next)
+                want_next = true;       // the last attempt failed; try again
+            wake.notify_one();
+            ready.wait(hold, [&]() { return have_next || !want_next; });
+            if (current.base)
+                to_close.push_back(current);
+            current = sink_detail::segment();
+            if (have_next)
+            {
+                current   = prepared;
+                have_next = false;
+            }
+            want_next = true;
+        }
+        wake.notify_one();
+        prologue_size = 0;
+        if (!current.base)
+            return;
+        current.opened = std::chrono::steady_clock::now();
+        if (prologue)
+        {
+            std::string text = prologue();
+            std::size_t n    = text.size() < current.size ? text.size() : current.size;
+            std::memcpy(current.base, text.data(), n);
+            current.used  = n;
+            prologue_size = n;
+        }
+    }
+
+    // makes the next segment and finishes the closed ones
+    void background()
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        for (;;)
+        {
+            wake.wait(hold, [&]() { return stopping || (want_next && !have_next) || !to_close.empty(); });
+            if (want_next && !have_next)
+            {
+                unsigned long n = next++;
+                hold.unlock();
+                sink_detail::segment s;
+                bool ok = sink_detail::open_segment(s, name(n), rules.segment_bytes);
+                hold.lock();
+                if (ok)
+                {
+                    prepared  = s;
+                    have_next = true;
+                }
+                else
+                    want_next = false;      // rotate() asks again
+                ready.notify_all();
+            }
+            else if (!to_close.empty())
+            {
+                sink_detail::segment s = to_close.front();
+                to_close.pop_front();
+                hold.unlock();
+                finish(s);
+                hold.lock();
+            }
+            else if (stopping)
+                return;
+        }
+    }
+
+    void finish(sink_detail::segment& s)
+    {
+        sink_detail::close_segment(s);
+        std::string kept = s.path;
+        if (s.used == 0)
+        {
+            ::unlink(s.path.c_str());
+            return;
+        }
+        if (rules.compress && sink_detail::compress(s.path))
+            kept += ".gz";
+        closed.push_back(kept);
+        while (rules.keep && closed.size() > rules.keep)
+        {
+            ::unlink(closed.front().c_str());
+            closed.pop_front();
+        }
+    }
+
+    std::string                     base;
+    log_rotation                    rules;
+
+    // the writer thread's
+    sink_detail::segment            current;
+    std::size_t                     prologue_size;
+    std::function<std::string()>    prologue;
+
+    std::mutex                      lock;       // everything below but closed
+    std::condition_variable         wake;       // for the background thread
+    std::condition_variable         ready;      // for rotate()
+    unsigned long                   next;
+    bool                            want_next;
+    bool                            have_next;
+    sink_detail::segment            prepared;
+    std::deque<sink_detail::segment> to_close;
+    bool                            stopping;
+    std::deque<std::string>         closed;     // the background thread's, oldest first
+    std::thread                     worker;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef NUMERIC_TABLES_H
+#define NUMERIC_TABLES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Numeric constants and tables computed by the compiler, so that using them costs a load from
+ * read-only data instead of a loop at run time:
+ *
+ *  machine_epsilon<T>()        the halving loop of simpson(), for float, double or long double
+ *  primes_upto<N>()            std::array of the primes <= N
+ *  smallest_factor_table<N>()  std::array with the smallest prime factor of every i <= N
+ *                              (0 for 0 and 1), which factorize() walks
+ *
+ *  small_primes                primes_upto<1000>(), the range surprise() prints
+ *  smallest_factor             smallest_factor_table<16383>(), 32 KiB
+ *
+ * Everything is constexpr (C++17 has no consteval); the inline constexpr constants are always
+ * built at compile time.
+ */
+
+template <typename T> constexpr T machine_epsilon()
+{
+    T eps = 1;
+    while (T(1) + eps > T(1))
+        eps = eps / 2;
+    return eps * 2;
+}
+
+namespace table_detail
+{
+    template <std::size_t N> constexpr std::array<bool, N + 1> composite_flags()
+    {
+        std::array<bool, N + 1> composite = {};
+        for (std::size_t i = 2; i * i <= N; i++)
+        {
+            if (composite[i])
+                continue;
+            for (std::size_t m = i * i; m <= N; m += i)
+                composite[m] = true;
+        }
+        return composite;
+    }
+
+    template <std::size_t N> constexpr std::size_t count_upto()
+    {
+        std::array<bool, N + 1> composite = composite_flags<N>();
+        std::size_t n = 0;
+        for (std::size_t i = 2; i <= N; i++)
+            n += !composite[i];
+        return n;
+    }
+
+    // the smallest type that holds every value up to N
+    template <std::size_t N> struct index_type
+    {
+        typedef typename std::conditional<N <= 0xFFFF, std::uint16_t, std::uint32_t>::type type;
+    };
+}
+
+template <std::size_t N>
+constexpr std::array<typename table_detail::index_type<N>::type, table_detail::count_upto<N>()> primes_upto()
+{
+    std::array<bool, N + 1> composite = table_detail::composite_flags<N>();
+    std::array<typename table_detail::index_type<N>::type, table_detail::count_upto<N>()> primes = {};
+    std::size_t n = 0;
+    for (std::size_t i = 2; i <= N; i++)
+    {
+        if (!composite[i])
+            primes[n++] = typename table_detail::index_type<N>::type(i);
+    }
+    return primes;
+}
+
+template <std::size_t N>
+constexpr std::array<typename table_detail::index_type<N>::type, N + 1> smallest_factor_table()
+{
+    std::array<typename table_detail::index_type<N>::type, N + 1> factor = {};
+    for (std::size_t i = 2; i <= N; i++)
+    {
+        if (factor[i])
+            continue;
+        for (std::size_t m = i; m <= N; m += i)
+        {
+            if (!factor[m])
+                factor[m] = typename table_detail::index_type<N>::type(i);
+        }
+    }
+    return factor;
+}
+
+inline constexpr auto small_primes    = primes_upto<1000>();
+inline constexpr auto smallest_factor = smallest_factor_table<16383>();
+
+// writes the prime factors of 2 <= n <= 16383 in increasing order, with repeats; returns how many.
+// Throws std::out_of_range above 16383, which is a compile error in a constant expression
+constexpr std::size_t factorize(std::uint32_t n, std::uint32_t* out)
+{
+    if (n >= smallest_factor.size())
+        throw std::out_of_range("factorize: n must be at most 16383");
+
+    std::size_t count = 0;
+    while (n > 1)
+    {
+        std::uint32_t p = smallest_factor[n];
+        out[count++] = p;
+        n /= p;
+    }
+    return count;
+}
+
+static_assert(machine_epsilon<double>() == std::numeric_limits<double>::epsilon(), "IEEE double expected");
+static_assert(small_primes.size() == 168 && small_primes.back() == 997, "pi(1000) is 168");
+
+#endif
@@ -0,0 +1,487 @@
+#ifndef PREFIX_SCAN_H
+#define PREFIX_SCAN_H
+
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cpu_dispatch.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Prefix sum (inclusive scan) engine used by sumcum():  c[j] = a[0] + a[1] + ... + a[j]
+ *
+ *  - int, float and double are scanned inside SIMD registers (AVX2 or SSE2, whichever
+ *    active_cpu_level() allows): log2(width) shift-and-add steps per vector plus one add of
+ *    the running total, instead of one dependent add per element.
+ *  - large arrays use a two-pass blocked algorithm over threads: every thread sums its
+ *    block, the block sums are scanned, then every thread scans its block starting from
+ *    the total of the blocks before it.
+ *  - a and c may be the same array (in-place scan).
+ *
+ * For float and double the additions are grouped differently from the serial loop, so the
+ * last bits can differ from it. Long series should use scan_compensated, below.
+ */
+
+namespace scan_detail
+{
+    // below this many elements a single thread is faster than starting more
+    const std::size_t parallel_threshold = std::size_t(1) << 20;
+
+    // serial scan of n elements starting from carry; returns the last output
+    template <typename T> T scan_serial(const T* a, T* c, std::size_t n, T carry)
+    {
+        for (std::size_t j = 0; j < n; j++)
+        {
+            carry = carry + a[j];
+            c[j]  = carry;
+        }
+        return carry;
+    }
+
+    // the vector adds wrap around, so the scalar scan of int does the same instead of overflowing
+    inline int scan_serial_wrap(const int* a, int* c, std::size_t n, int carry)
+    {
+        unsigned t = unsigned(carry);
+        for (std::size_t j = 0; j < n; j++)
+        {
+            t   += unsigned(a[j]);
+            c[j] = int(t);
+        }
+        return int(t);
+    }
+
+    template <typename T> T scan_block(const T* a, T* c, std::size_t n, T carry)
+    {
+        return scan_serial(a, c, n, carry);
+    }
+
+#if defined(__SSE2__)
+    inline double scan_sse2(const double* a, double* c, std::size_t n, double carry)
+    {
+        std::size_t j    = 0;
+        __m128d zero     = _mm_setzero_pd();
+        __m128d total    = _mm_set1_pd(carry);
+        for (; j + 2 <= n; j += 2)
+        {
+            __m128d x = _mm_loadu_pd(a + j);
+            x = _mm_add_pd(x, _mm_shuffle_pd(zero, x, 0x0));
+            x = _mm_add_pd(x, total);
+            _mm_storeu_pd(c + j, x);
+            total = _mm_unpackhi_pd(x, x);
+        }
+        return scan_serial(a + j, c + j, n - j, _mm_cvtsd_f64(total));
+    }
+
+    inline float scan_sse2(const float* a, float* c, std::size_t n, float carry)
+    {
+        std::size_t j    = 0;
+        __m128 total     = _mm_set1_ps(carry);
+        for (; j + 4 <= n; j += 4)
+        {
+            __m128 x = _mm_loadu_ps(a + j);
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+            x = _mm_add_ps(x, total);
+            _mm_storeu_ps(c + j, x);
+            total = _mm_shuffle_ps(x, x, 0xFF);
+        }
+        return scan_serial(a + j, c + j, n - j, _mm_cvtss_f32(total));
+    }
+
+    inline int scan_sse2(const int* a, int* c, std::size_t n, int carry)
+    {
+        std::size_t j    = 0;
+        __m128i total    = _mm_set1_epi32(carry);
+        for (; j + 4 <= n; j += 4)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + j));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi32(x, total);
+            _mm_storeu_si128((__m128i*)(c + j), x);
+            total = _mm_shuffle_epi32(x, 0xFF);
+        }
+        return scan_serial_wrap(a + j, c + j, n - j, _mm_cvtsi128_si32(total));
+    }
+
+    __attribute__((target("avx2"))) inline double scan_avx2(const double* a, double* c, std::size_t n, double carry)
+    {
+        std::size_t j    = 0;
+        __m256d zero     = _mm256_setzero_pd();
+        __m256d total    = _mm256_set1_pd(carry);
+        for (; j + 4 <= n; j += 4)
+        {
+            __m256d x = _mm256_loadu_pd(a + j);
+            // shift the lanes up by one, then by two, filling with zero
+            x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x90), zero, 0x1));
+            x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x40), zero, 0x3));
+            x = _mm256_add_pd(x, total);
+            _mm256_storeu_pd(c + j, x);
+            total = _mm256_permute4x64_pd(x, 0xFF);
+        }
+        return scan_serial(a + j, c + j, n - j, _mm256_cvtsd_f64(total));
+    }
+
+    __attribute__((target("avx2"))) inline float scan_avx2(const float* a, float* c, std::size_t n, float carry)
+    {
+        std::size_t j    = 0;
+        __m256i last     = _mm256_set1_epi32(7);
+        __m256 total     = _mm256_set1_ps(carry);
+        for (; j + 8 <= n; j += 8)
+        {
+            __m256 x = _mm256_loadu_ps(a + j);
+            // scan both 128-bit halves, then add the low half's total to the high half
+            x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+            x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+            __m256 low = _mm256_permute2f128_ps(x, x, 0x08);
+            x = _mm256_add_ps(x, _mm256_shuffle_ps(low, low, 0xFF));
+            x = _mm256_add_ps(x, total);
+            _mm256_storeu_ps(c + j, x);
+            total = _mm256_permutevar8x32_ps(x, last);
+        }
+        return scan_serial(a + j, c + j, n - j, _mm256_cvtss_f32(total));
+    }
+
+    __attribute__((target("avx2"))) inline int scan_avx2(const int* a, int* c, std::size_t n, int carry)
+    {
+        std::size_t j    = 0;
+        __m256i last     = _mm256_set1_epi32(7);
+        __m256i total    = _mm256_set1_epi32(carry);
+        for (; j + 8 <= n; j += 8)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+            x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+            x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+            __m256i low = _mm256_permute2x128_si256(x, x, 0x08);
+            x = _mm256_add_epi32(x, _mm256_shuffle_epi32(low, 0xFF));
+            x = _mm256_add_epi32(x, total);
+            _mm256_storeu_si256((__m256i*)(c + j), x);
+            total = _mm256_permutevar8x32_epi32(x, last);
+        }
+        return scan_serial_wrap(a + j, c + j, n - j, _mm256_cvtsi256_si32(total));
+    }
+
+    // bound to the variant for active_cpu_level() on the first call
+    template <typename T> using scan_fn = T (*)(const T*, T*, std::size_t, T);
+
+    template <> inline double scan_block<double>(const double* a, double* c, std::size_t n, double carry)
+    {
+        static const scan_fn<double> kernel = select_kernel<scan_fn<double> >(scan_serial<double>, scan_sse2, scan_avx2, 0);
+        return kernel(a, c, n, carry);
+    }
+
+    template <> inline float scan_block<float>(const float* a, float* c, std::size_t n, float carry)
+    {
+        static const scan_fn<float> kernel = select_kernel<scan_fn<float> >(scan_serial<float>, scan_sse2, scan_avx2, 0);
+        return kernel(a, c, n, carry);
+    }
+
+    template <> inline int scan_block<int>(const int* a, int* c, std::size_t n, int carry)
+    {
+        static const scan_fn<int> kernel = select_kernel<scan_fn<int> >(scan_serial_wrap, scan_sse2, scan_avx2, 0);
+        return kernel(a, c, n, carry);
+    }
+#else
+    template <> inline int scan_block<int>(const int* a, int* c, std::size_t n, int carry)
+    {
+        return scan_serial_wrap(a, c, n, carry);
+    }
+#endif
+
+    // sum of a block, with four independent accumulators so the adds can overlap
+    template <typename T> T reduce_block(const T* a, std::size_t n)
+    {
+        T s0 = T(), s1 = T(), s2 = T(), s3 = T();
+        std::size_t j = 0;
+        for (; j + 4 <= n; j += 4)
+        {
+            s0 = s0 + a[j];
+            s1 = s1 + a[j + 1];
+            s2 = s2 + a[j + 2];
+            s3 = s3 + a[j + 3];
+        }
+        for (; j < n; j++)
+            s0 = s0 + a[j];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    template <> inline int reduce_block<int>(const int* a, std::size_t n)
+    {
+        // unsigned, so that the sum wraps like the vector scan does
+        unsigned s = 0;
+        for (std::size_t j = 0; j < n; j++)
+            s += unsigned(a[j]);
+        return int(s);
+    }
+
+    // an unevaluated sum hi + lo, where lo collects the rounding errors of hi
+    template <typename T> struct compensated
+    {
+        T hi;
+        T lo;
+    };
+
+    // Knuth's TwoSum: returns a + b rounded, and its rounding error in e, exactly
+    template <typename T> inline T two_sum(T a, T b, T& e)
+    {
+        T s  = a + b;
+        T bb = s - a;
+        e    = (a - (s - bb)) + (b - bb);
+        return s;
+    }
+
+    template <typename T> inline compensated<T> add_compensated(compensated<T> x, compensated<T> y)
+    {
+        T e;
+        T s  = two_sum(x.hi, y.hi, e);
+        e    = e + (x.lo + y.lo);
+        T hi = s + e;
+        // renormalise, so that lo stays small next to hi
+        compensated<T> r = { hi, e - (hi - s) };
+        return r;
+    }
+
+    template <typename T> inline compensated<T> add_compensated(compensated<T> x, T y)
+    {
+        T e;
+        T s  = two_sum(x.hi, y, e);
+        e    = e + x.lo;
+        T hi = s + e;
+        compensated<T> r = { hi, e - (hi - s) };
+        return r;
+    }
+
+    template <typename T> compensated<T> scan_compensated_serial(const T* a, T* c, std::size_t n, compensated<T> carry)
+    {
+        for (std::size_t j = 0; j < n; j++)
+        {
+            carry = add_compensated(carry, a[j]);
+            c[j]  = carry.hi;
+        }
+        return carry;
+    }
+
+    template <typename T> compensated<T> scan_compensated(const T* a, T* c, std::size_t n, compensated<T> carry)
+    {
+        return scan_compensated_serial(a, c, n, carry);
+    }
+
+    // the in-register scans of scan_block<double>, with every add made exact by TwoSum and
+    // the errors scanned alongside in a second register
+#if defined(__SSE2__)
+    inline __m128d two_sum_pd(__m128d a, __m128d b, __m128d& e)
+    {
+        __m128d s  = _mm_add_pd(a, b);
+        __m128d bb = _mm_sub_pd(s, a);
+        e = _mm_add_pd(_mm_sub_pd(a, _mm_sub_pd(s, bb)), _mm_sub_pd(b, bb));
+        return s;
+    }
+
+    inline compensated<double> scan_compensated_sse2(const double* a, double* c, std::size_t n,
+                                                     compensated<double> carry)
+    {
+        std::size_t j    = 0;
+        __m128d zero     = _mm_setzero_pd();
+        __m128d hiTotal  = _mm_set1_pd(carry.hi);
+        __m128d loTotal  = _mm_set1_pd(carry.lo);
+        for (; j + 2 <= n; j += 2)
+        {
+            __m128d lo, e;
+            __m128d hi = _mm_loadu_pd(a + j);
+            hi = two_sum_pd(hi, _mm_shuffle_pd(zero, hi, 0x0), lo);
+
+            hi = two_sum_pd(hi, hiTotal, e);
+            lo = _mm_add_pd(_mm_add_pd(lo, loTotal), e);
+
+            __m128d sum = _mm_add_pd(hi, lo);
+            _mm_storeu_pd(c + j, sum);
+            hiTotal = _mm_unpackhi_pd(sum, sum);
+            lo      = _mm_sub_pd(lo, _mm_sub_pd(sum, hi));
+            loTotal = _mm_unpackhi_pd(lo, lo);
+        }
+        carry.hi = _mm_cvtsd_f64(hiTotal);
+        carry.lo = _mm_cvtsd_f64(loTotal);
+        return scan_compensated_serial(a + j, c + j, n - j, carry);
+    }
+
+    __attribute__((target("avx2"))) inline __m256d two_sum_pd(__m256d a, __m256d b, __m256d& e)
+    {
+        __m256d s  = _mm256_add_pd(a, b);
+        __m256d bb = _mm256_sub_pd(s, a);
+        e = _mm256_add_pd(_mm256_sub_pd(a, _mm256_sub_pd(s, bb)), _mm256_sub_pd(b, bb));
+        return s;
+    }
+
+    __attribute__((target("avx2"))) inline compensated<double> scan_compensated_avx2(const double* a, double* c,
+                                                                                     std::size_t n, compensated<double> carry)
+    {
+        std::size_t j    = 0;
+        __m256d zero     = _mm256_setzero_pd();
+        __m256d hiTotal  = _mm256_set1_pd(carry.hi);
+        __m256d loTotal  = _mm256_set1_pd(carry.lo);
+        for (; j + 4 <= n; j += 4)
+        {
+            __m256d lo, e;
+            __m256d hi = _mm256_loadu_pd(a + j);
+            hi = two_sum_pd(hi, _mm256_blend_pd(_mm256_permute4x64_pd(hi, 0x90), zero, 0x1), lo);
+
+            __m256d shifted = _mm256_blend_pd(_mm256_permute4x64_pd(lo, 0x40), zero, 0x3);
+            hi = two_sum_pd(hi, _mm256_blend_pd(_mm256_permute4x64_pd(hi, 0x40), zero, 0x3), e);
+            lo = _mm256_add_pd(_mm256_add_pd(lo, shifted), e);
+
+            hi = two_sum_pd(hi, hiTotal, e);
+            lo = _mm256_add_pd(_mm256_add_pd(lo, loTotal), e);
+
+            __m256d sum = _mm256_add_pd(hi, lo);
+            _mm256_storeu_pd(c + j, sum);
+            hiTotal = _mm256_permute4x64_pd(sum, 0xFF);
+            loTotal = _mm256_permute4x64_pd(_mm256_sub_pd(lo, _mm256_sub_pd(sum, hi)), 0xFF);
+        }
+        carry.hi = _mm256_cvtsd_f64(hiTotal);
+        carry.lo = _mm256_cvtsd_f64(loTotal);
+        return scan_compensated_serial(a + j, c + j, n - j, carry);
+    }
+
+    template <> inline compensated<double> scan_compensated<double>(const double* a, double* c, std::size_t n,
+                                                                   compensated<double> carry)
+    {
+        typedef compensated<double> (*fn)(const double*, double*, std::size_t, compensated<double>);
+        static const fn kernel = select_kernel<fn>(scan_compensated_serial<double>, scan_compensated_sse2,
+                                                   scan_compensated_avx2, 0);
+        return kernel(a, c, n, carry);
+    }
+#endif
+
+    template <typename T> compensated<T> reduce_compensated(const T* a, std::size_t n)
+    {
+        compensated<T> s[4] = {};
+        std::size_t j = 0;
+        for (; j + 4 <= n; j += 4)
+        {
+            for (int k = 0; k < 4; k++)
+                s[k] = add_compensated(s[k], a[j + k]);
+        }
+        for (; j < n; j++)
+            s[0] = add_compensated(s[0], a[j]);
+        return add_compensated(add_compensated(s[0], s[1]), add_compensated(s[2], s[3]));
+    }
+
+    // the plain scan as a kernel for scan_parallel(): a carry type and its identity, the sum of
+    // a block, how two carries combine, and the scan of a block from a carry
+    template <typename T> struct sum_kernel
+    {
+        typedef T carry_type;
+
+        T identity() const                                          { return T(); }
+        T reduce(const T* a, std::size_t n) const                   { return reduce_block(a, n); }
+        T combine(T x, T y) const                                   { return x + y; }
+        T scan(const T* a, T* c, std::size_t n, T carry) const      { return scan_block(a, c, n, carry); }
+    };
+
+    template <typename T> struct compensated_kernel
+    {
+        typedef compensated<T> carry_type;
+
+        carry_type identity() const                                 { return carry_type(); }
+        carry_type reduce(const T* a, std::size_t n) const          { return reduce_compensated(a, n); }
+        carry_type combine(carry_type x, carry_type y) const        { return add_compensated(x, y); }
+        carry_type scan(const T* a, T* c, std::size_t n, carry_type carry) const
+        {
+            return scan_compensated(a, c, n, carry);
+        }
+    };
+
+    template <typename K, typename T> void scan_parallel(const K& k, const T* a, T* c, std::size_t n, unsigned threads)
+    {
+        typedef typename K::carry_type C;
+
+        std::size_t block = (n + threads - 1) / threads;
+        std::vector<C> sums(threads, k.identity());
+        std::vector<std::thread> pool;
+
+        // pass 1: the total of every block
+        for (unsigned t = 1; t < threads; t++)
+        {
+            std::size_t from = t * block < n ? t * block : n;
+            std::size_t len  = from + block < n ? block : n - from;
+            pool.push_back(std::thread([=, &k, &sums]() { sums[t] = k.reduce(a + from, len); }));
+        }
+        sums[0] = k.reduce(a, block < n ? block : n);
+        for (std::size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+        pool.clear();
+
+        // the block totals become the carry into every block
+        C carry = k.identity();
+        for (unsigned t = 0; t < threads; t++)
+        {
+            C s     = sums[t];
+            sums[t] = carry;
+            carry   = k.combine(carry, s);
+        }
+
+        // pass 2: scan every block from its carry
+        for (unsigned t = 1; t < threads; t++)
+        {
+            std::size_t from = t * block < n ? t * block : n;
+            std::size_t len  = from + block < n ? block : n - from;
+            pool.push_back(std::thread([=, &k, &sums]() { k.scan(a + from, c + from, len, sums[t]); }));
+        }
+        k.scan(a, c, block < n ? block : n, k.identity());
+        for (std::size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+    }
+}
+
+// scan_fast is plain floating point addition, so the error can grow with n. scan_compensated
+// carries the rounding error of every add along (TwoSum), so every output is within about one
+// rounding of the exact prefix sum, for two to three times the work; it only changes the result
+// for floating point types, and needs a build without -ffast-math.
+enum scan_accuracy { scan_fast, scan_compensated };
+
+// c[j] = a[0] + ... + a[j]; c may be a. threads == 0 uses every hardware thread
+// for arrays large enough to benefit.
+template <typename T> void prefix_sum(const T* a, T* c, std::size_t n, scan_accuracy accuracy, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    bool parallel = threads > 1 && n >= scan_detail::parallel_threshold;
+
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        if (accuracy == scan_compensated)
+        {
+            if (parallel)
+                scan_detail::scan_parallel(scan_detail::compensated_kernel<T>(), a, c, n, threads);
+            else
+                scan_detail::scan_compensated(a, c, n, scan_detail::compensated<T>());
+            return;
+        }
+    }
+    if (parallel)
+        scan_detail::scan_parallel(scan_detail::sum_kernel<T>(), a, c, n, threads);
+    else
+        scan_detail::scan_block(a, c, n, T());
+}
+
+template <typename T> void prefix_sum(const T* a, T* c, std::size_t n, unsigned threads = 0)
+{
+    prefix_sum(a, c, n, scan_fast, threads);
+}
+
+template <typename T> void prefix_sum_inplace(T* a, std::size_t n, scan_accuracy accuracy, unsigned threads = 0)
+{
+    prefix_sum(a, a, n, accuracy, threads);
+}
+
+template <typename T> void prefix_sum_inplace(T* a, std::size_t n, unsigned threads = 0)
+{
+    prefix_sum(a, a, n, scan_fast, threads);
+}
+
+#endif
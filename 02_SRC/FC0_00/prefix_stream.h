@@ -0,0 +1,209 @@
+#ifndef PREFIX_STREAM_H
+#define PREFIX_STREAM_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "prefix_scan.h"
+
+/**
+ * Streaming prefix sums: the input is consumed chunk by chunk, the running total is carried
+ * from one chunk to the next, and the output is written as soon as a chunk is done, so
+ * memory stays bounded by the chunk size however long the series is.
+ *
+ *  prefix_stream<T>        the building block: push() one chunk at a time
+ *  prefix_sum_stream()     from an input iterator range to an output iterator
+ *  prefix_sum_file()       from a binary file of T to another binary file of T
+ *  prefix_sum_mapped()     same, reading the input through a memory mapping, window by
+ *                          window, and dropping every window once it is done
+ *
+ * The file functions throw std::runtime_error when a file cannot be read or written, including
+ * when the output cannot be flushed to disk at the end, and when the input ends in part of an
+ * element: prefix_sum_mapped before it writes anything, prefix_sum_file once it has written the
+ * sums of the whole elements.
+ */
+
+template <typename T> class prefix_stream
+{
+public:
+    explicit prefix_stream(T start = T()) : total(start) {}
+
+    // scans the next n elements; out may be in
+    void push(const T* in, T* out, std::size_t n)
+    {
+        total = scan_detail::scan_block(in, out, n, total);
+    }
+
+    T    running_total() const       { return total; }
+    void reset(T start = T())        { total = start; }
+
+private:
+    T total;
+};
+
+template <typename InputIt, typename OutputIt>
+OutputIt prefix_sum_stream(InputIt first, InputIt last, OutputIt out, std::size_t chunk = 1 << 16)
+{
+    typedef typename std::iterator_traits<InputIt>::value_type T;
+
+    std::vector<T>    buffer(chunk ? chunk : 1);
+    prefix_stream<T>  scan;
+    while (first != last)
+    {
+        std::size_t n = 0;
+        for (; n < buffer.size() && first != last; ++first, ++n)
+            buffer[n] = *first;
+
+        scan.push(buffer.data(), buffer.data(), n);
+        for (std::size_t j = 0; j < n; j++)
+            *out++ = buffer[j];
+    }
+    return out;
+}
+
+namespace scan_detail
+{
+    struct file_closer
+    {
+        std::FILE* f;
+        ~file_closer() { if (f) std::fclose(f); }
+    };
+
+    // the last buffered write may fail only here, as on a full disk
+    inline void close_or_throw(file_closer& out, const char* path)
+    {
+        bool ok = std::fflush(out.f) == 0 && !std::ferror(out.f);
+        ok      = std::fclose(out.f) == 0 && ok;
+        out.f   = 0;
+        if (!ok)
+            throw std::runtime_error(std::string("prefix sum: cannot write ") + path);
+    }
+
+    inline void partial_element(const char* path, std::size_t bytes)
+    {
+        throw std::runtime_error(std::string("prefix sum: ") + path + " ends in a partial element of " +
+                                 std::to_string(bytes) + " bytes");
+    }
+
+    inline std::FILE* open_or_throw(const char* path, const char* mode)
+    {
+        std::FILE* f = std::fopen(path, mode);
+        if (!f)
+            throw std::runtime_error(std::string("prefix sum: cannot open ") + path);
+        return f;
+    }
+}
+
+// returns the number of elements written to out_path
+template <typename T>
+std::size_t prefix_sum_file(const char* in_path, const char* out_path, std::size_t chunk = 1 << 20)
+{
+    scan_detail::file_closer in  = { scan_detail::open_or_throw(in_path, "rb") };
+    scan_detail::file_closer out = { scan_detail::open_or_throw(out_path, "wb") };
+
+    std::vector<T>    buffer(chunk ? chunk : 1);
+    prefix_stream<T>  scan;
+    std::size_t       count = 0;
+    std::size_t       carry = 0;    // bytes of an element split between two reads
+    char*             bytes = reinterpret_cast<char*>(buffer.data());
+    for (;;)
+    {
+        std::size_t got  = carry + std::fread(bytes + carry, 1, buffer.size() * sizeof(T) - carry, in.f);
+        std::size_t n    = got / sizeof(T);
+        std::size_t rest = got - n * sizeof(T);
+        carry = rest;
+        if (n == 0)
+            break;
+        char tail[sizeof(T)];
+        std::memcpy(tail, bytes + n * sizeof(T), rest);
+        scan.push(buffer.data(), buffer.data(), n);
+        if (std::fwrite(buffer.data(), sizeof(T), n, out.f) != n)
+            throw std::runtime_error(std::string("prefix sum: cannot write ") + out_path);
+        std::memcpy(bytes, tail, rest);
+        count += n;
+    }
+    if (std::ferror(in.f))
+        throw std::runtime_error(std::string("prefix sum: cannot read ") + in_path);
+    scan_detail::close_or_throw(out, out_path);
+    if (carry)
+        scan_detail::partial_element(in_path, carry);
+    return count;
+}
+
+// window is the number of bytes of input mapped at a time (rounded to whole pages)
+template <typename T>
+std::size_t prefix_sum_mapped(const char* in_path, const char* out_path, std::size_t window = std::size_t(64) << 20)
+{
+    int fd = ::open(in_path, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(std::string("prefix sum: cannot open ") + in_path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error(std::string("prefix sum: cannot stat ") + in_path);
+    }
+
+    // whole elements per window, and windows starting on page boundaries
+    std::size_t page  = std::size_t(sysconf(_SC_PAGESIZE));
+    std::size_t step  = window / (page * sizeof(T)) * (page * sizeof(T));
+    if (step == 0)
+        step = page * sizeof(T);
+
+    std::size_t total = std::size_t(st.st_size);
+    if (total % sizeof(T))
+    {
+        ::close(fd);
+        scan_detail::partial_element(in_path, total % sizeof(T));
+    }
+    scan_detail::file_closer out = { std::fopen(out_path, "wb") };
+    if (!out.f)
+    {
+        ::close(fd);
+        throw std::runtime_error(std::string("prefix sum: cannot open ") + out_path);
+    }
+
+    std::vector<T>    buffer(step / sizeof(T) < (std::size_t(1) << 20) ? step / sizeof(T) : std::size_t(1) << 20);
+    prefix_stream<T>  scan;
+    for (std::size_t offset = 0; offset < total; offset += step)
+    {
+        std::size_t bytes = total - offset < step ? total - offset : step;
+        void* m = mmap(0, bytes, PROT_READ, MAP_PRIVATE, fd, off_t(offset));
+        if (m == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error(std::string("prefix sum: cannot map ") + in_path);
+        }
+        madvise(m, bytes, MADV_SEQUENTIAL);
+
+        const T* in = (const T*)m;
+        for (std::size_t j = 0; j < bytes / sizeof(T); j += buffer.size())
+        {
+            std::size_t n = bytes / sizeof(T) - j < buffer.size() ? bytes / sizeof(T) - j : buffer.size();
+            scan.push(in + j, buffer.data(), n);
+            if (std::fwrite(buffer.data(), sizeof(T), n, out.f) != n)
+            {
+                munmap(m, bytes);
+                ::close(fd);
+                throw std::runtime_error(std::string("prefix sum: cannot write ") + out_path);
+            }
+        }
+        munmap(m, bytes);
+    }
+    ::close(fd);
+    scan_detail::close_or_throw(out, out_path);
+    return total / sizeof(T);
+}
+
+#endif
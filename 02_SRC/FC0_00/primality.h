@@ -0,0 +1,449 @@
+#ifndef PRIMALITY_H
+#define PRIMALITY_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "prime_sieve.h"
+
+/**
+ * Primality testing and prime counting for 64-bit numbers.
+ *
+ *  isPrime(n)                  deterministic Miller-Rabin with Montgomery multiplication: the
+ *                              bases 2, 7, 61 below 2^32, and the seven bases of Jim Sinclair,
+ *                              2, 325, 9375, 28178, 450775, 9780504, 1795265022, above
+ *  isPrime(n, out, count)      the same over an array; the base 2 test runs on four numbers at
+ *                              once, so the multiplications of one overlap with the others
+ *  primeCount(x)               the number of primes <= x by the combinatorial method of
+ *                              Lagarias, Miller and Odlyzko, in about x^(2/3) time, instead of
+ *                              sieving all of [2, x]; memory is the primes up to sqrt(x), one
+ *                              sieve segment and tables up to x^(1/3). x is at most 10^17, where
+ *                              the primes alone take 70 MB and the count some minutes (10^15
+ *                              takes about 15 s); std::out_of_range is thrown above
+ */
+
+namespace primality_detail
+{
+    typedef unsigned __int128 u128;
+
+    // arithmetic modulo an odd n in Montgomery form: a is kept as a * 2^64 mod n
+    struct montgomery
+    {
+        std::uint64_t n;
+        std::uint64_t inv;      // n^-1 mod 2^64
+        std::uint64_t one;      // 2^64 mod n
+        std::uint64_t r2;       // 2^128 mod n
+
+        explicit montgomery(std::uint64_t m) : n(m)
+        {
+            // Newton's iteration, every step doubles the correct low bits (n * n == 1 mod 8)
+            inv = m;
+            for (int i = 0; i < 5; i++)
+                inv *= 2 - m * inv;
+            one = (0 - m) % m;
+            r2  = std::uint64_t(u128(one) * one % m);
+        }
+
+        // t / 2^64 mod n, for t < n * 2^64
+        std::uint64_t reduce(u128 t) const
+        {
+            std::uint64_t m  = std::uint64_t(t) * inv;
+            std::uint64_t hi = std::uint64_t(t >> 64);
+            std::uint64_t mn = std::uint64_t((u128(m) * n) >> 64);
+            return hi >= mn ? hi - mn : hi - mn + n;
+        }
+
+        std::uint64_t mul(std::uint64_t a, std::uint64_t b) const   { return reduce(u128(a) * b); }
+        std::uint64_t to(std::uint64_t a) const                     { return mul(a % n, r2); }
+
+        std::uint64_t pow(std::uint64_t a, std::uint64_t e) const
+        {
+            std::uint64_t r = one;
+            for (; e; e >>= 1)
+            {
+                if (e & 1)
+                    r = mul(r, a);
+                a = mul(a, a);
+            }
+            return r;
+        }
+    };
+
+    // the strong probable prime test of odd n > 2 to base a, with n - 1 = d * 2^s
+    inline bool strong_probable_prime(const montgomery& m, std::uint64_t a, std::uint64_t d, int s)
+    {
+        a = a % m.n;
+        if (a == 0)
+            return true;
+
+        std::uint64_t minus_one = m.n - m.one;
+        std::uint64_t x         = m.pow(m.to(a), d);
+        if (x == m.one || x == minus_one)
+            return true;
+        for (int i = 1; i < s; i++)
+        {
+            x = m.mul(x, x);
+            if (x == minus_one)
+                return true;
+            if (x == m.one)
+                return false;
+        }
+        return false;
+    }
+
+    const std::uint32_t small_primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+
+    // 0 when n is composite, 1 when prime, 2 when trial division by small_primes cannot tell
+    inline int trial(std::uint64_t n)
+    {
+        if (n < 2)
+            return 0;
+        for (std::uint32_t p : small_primes)
+        {
+            if (n % p == 0)
+                return n == p;
+        }
+        return n < 41 * 41 ? 1 : 2;
+    }
+
+    // Miller-Rabin for odd n >= 41^2 with no factor in small_primes; from = 1 skips base 2
+    inline bool miller_rabin(std::uint64_t n, int from = 0)
+    {
+        static const std::uint64_t small_bases[] = { 2, 7, 61 };
+        static const std::uint64_t large_bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+
+        montgomery m(n);
+        std::uint64_t d = n - 1;
+        int s = __builtin_ctzll(d);
+        d >>= s;
+
+        if (n < (std::uint64_t(1) << 32))
+        {
+            for (int i = from; i < 3; i++)
+                if (!strong_probable_prime(m, small_bases[i], d, s))
+                    return false;
+            return true;
+        }
+        for (int i = from; i < 7; i++)
+            if (!strong_probable_prime(m, large_bases[i], d, s))
+                return false;
+        return true;
+    }
+
+    // the base 2 test on four numbers at once; the powers are taken in lockstep over the longest
+    // exponent, so the four chains of multiplications are independent and can overlap
+    inline void base2_x4(const std::uint64_t* n, bool* out)
+    {
+        const int lanes = 4;
+        montgomery m[lanes] = { montgomery(n[0]), montgomery(n[1]), montgomery(n[2]), montgomery(n[3]) };
+        std::uint64_t d[lanes], x[lanes], b[lanes];
+        int s[lanes], top = 0;
+        for (int k = 0; k < lanes; k++)
+        {
+            s[k] = __builtin_ctzll(n[k] - 1);
+            d[k] = (n[k] - 1) >> s[k];
+            x[k] = m[k].one;
+            b[k] = m[k].to(2);
+            int bits = 64 - __builtin_clzll(d[k]);
+            if (bits > top)
+                top = bits;
+        }
+        for (int bit = top - 1; bit >= 0; bit--)
+        {
+            for (int k = 0; k < lanes; k++)
+            {
+                x[k] = m[k].mul(x[k], x[k]);
+                std::uint64_t y = m[k].mul(x[k], b[k]);
+                x[k] = (d[k] >> bit) & 1 ? y : x[k];
+            }
+        }
+        for (int k = 0; k < lanes; k++)
+        {
+            std::uint64_t minus_one = n[k] - m[k].one;
+            bool probable = x[k] == m[k].one || x[k] == minus_one;
+            for (int i = 1; i < s[k] && !probable; i++)
+            {
+                x[k] = m[k].mul(x[k], x[k]);
+                if (x[k] == minus_one)
+                    probable = true;
+                else if (x[k] == m[k].one)
+                    break;
+            }
+            out[k] = probable;
+        }
+    }
+
+    inline std::uint64_t iroot(std::uint64_t x, int k)
+    {
+        std::uint64_t r = std::uint64_t(std::pow(double(x), 1.0 / k));
+        auto power = [k](std::uint64_t v)
+        {
+            u128 p = 1;
+            for (int i = 0; i < k; i++)
+                p *= v;
+            return p;
+        };
+        while (r > 0 && power(r) > x)
+            r--;
+        while (power(r + 1) <= x)
+            r++;
+        return r;
+    }
+
+    // Lagarias-Miller-Odlyzko: pi(x) = phi(x, a) + a - 1 - P2 with a = pi(y) for a y of at least
+    // x^1/3, so that no number up to x has three prime factors above y, and P2 the sum of
+    // pi(x / p) - pi(p) + 1 over the primes y < p <= sqrt(x). phi(x, a) splits into the ordinary
+    // leaves mu(n) phi(x / n, c), n <= y, from the small tables, and the special leaves
+    // -mu(m) phi(x / (m p_b+1), b); those are all below x / y, and so are the x / p of P2, so one
+    // sieve of [1, x / y] counts them all as it crosses off the primes up to y in turn
+    class lmo
+    {
+    public:
+        explicit lmo(std::uint64_t x)
+            : x(x)
+        {
+            // a larger y leaves less to sieve and more special leaves; 4 x^1/3 is about where
+            // the two take the same time, from 10^12 to 10^16
+            y = iroot(x, 3) * 4;
+            if (y > sieve_detail::isqrt(x))
+                y = sieve_detail::isqrt(x);
+            z = x / y;
+
+            // p[1] = 2 first so that p[i] is the i-th prime, up to sqrt(x)
+            p = sieve_detail::base_primes(sieve_detail::isqrt(x));
+            p.insert(p.begin(), 2, 2);
+            a = 1;
+            while (a + 1 < p.size() && p[a + 1] <= y)
+                a++;
+            c = a < std::uint64_t(small_a) ? a : small_a;
+
+            // phi(v, c) repeats with the product of the first c primes
+            product = 1;
+            for (std::uint64_t i = 1; i <= c; i++)
+                product *= p[i];
+            small.assign(product, 0);
+            for (std::uint32_t v = 1; v < product; v++)
+            {
+                bool coprime = true;
+                for (std::uint64_t i = 1; i <= c; i++)
+                    coprime = coprime && v % p[i] != 0;
+                small[v] = std::uint16_t(small[v - 1] + coprime);
+            }
+            totient = small[product - 1];
+
+            // the least prime factor and the Moebius function up to y; 1 has no prime factor
+            lpf.assign(y + 1, ~std::uint32_t(0));
+            mu.assign(y + 1, 1);
+            for (std::uint64_t i = 1; i <= a; i++)
+            {
+                std::uint64_t q = p[i];
+                for (std::uint64_t m = q; m <= y; m += q)
+                {
+                    if (lpf[m] > q)
+                        lpf[m] = std::uint32_t(q);
+                    mu[m] = std::int8_t(-mu[m]);
+                }
+                for (std::uint64_t m = q * q; m <= y; m += q * q)
+                    mu[m] = 0;
+            }
+        }
+
+        std::uint64_t pi() const
+        {
+            // the ordinary leaves
+            std::int64_t sum = 0;
+            for (std::uint64_t n = 1; n <= y; n++)
+            {
+                if (mu[n] != 0 && lpf[n] > p[c])
+                    sum += mu[n] * phi_c(x / n);
+            }
+
+            // the sieve holds the odd numbers only; with 2 among the first c primes, phi(v, b)
+            // is the odd numbers up to v left after crossing off p[2..b]
+            std::vector<std::uint64_t> words(sieve_detail::segment_words);
+            std::vector<std::int64_t>  before(a + 1, 0);    // phi(low - 1, b)
+            std::vector<std::uint64_t> next(a + 1);         // the next odd multiple of p[i]
+            std::vector<std::uint64_t> leaf(a + 1);         // the next m of p[b + 1], from the top
+            std::vector<std::uint64_t> due(a + 1);          // and its x / (m p[b + 1])
+            for (std::uint64_t i = 2; i <= a; i++)
+                next[i] = p[i];
+            for (std::uint64_t b = c; b < a; b++)
+            {
+                // above sqrt(y), m is a prime between p[b + 1] and y, kept as its index
+                leaf[b] = p[b + 1] * std::uint64_t(p[b + 1]) > y ? a + 1 : y + 1;
+                due[b]  = following(b, leaf[b]);
+            }
+            std::uint64_t large = p.size() - 1;     // the next p of P2, from sqrt(x) down
+            std::int64_t  p2    = 0;
+            std::int64_t  left  = 0;                // the numbers below low left by every p <= y
+
+            for (std::uint64_t low = 1; low <= z; )
+            {
+                std::uint64_t odds  = (z - low) / 2 + 1;
+                std::size_t   bits  = std::size_t(odds < sieve_detail::segment_bits ? odds : sieve_detail::segment_bits);
+                std::uint64_t high  = low + 2 * bits;
+                std::int64_t  count = std::int64_t(bits);
+                for (std::size_t w = 0; w < (bits + 63) / 64; w++)
+                    words[w] = ~std::uint64_t(0);
+                if (bits % 64)
+                    words[(bits + 63) / 64 - 1] = (std::uint64_t(1) << (bits % 64)) - 1;
+
+                auto cross = [&](std::uint64_t i)
+                {
+                    std::uint64_t m = next[i];
+                    for (; m < high; m += 2 * std::uint64_t(p[i]))
+                    {
+                        std::uint64_t k   = (m - low) / 2;
+                        std::uint64_t bit = std::uint64_t(1) << (k % 64);
+                        count            -= std::int64_t((words[k / 64] & bit) != 0);
+                        words[k / 64]    &= ~bit;
+                    }
+                    next[i] = m;
+                };
+
+                // the set bits up to v, for v going up from low
+                std::size_t   word    = 0;
+                std::int64_t  running = 0;
+                auto upto = [&](std::uint64_t v)
+                {
+                    std::uint64_t k = (v - low) / 2;
+                    for (; word < k / 64; word++)
+                        running += __builtin_popcountll(words[word]);
+                    return running + __builtin_popcountll(words[k / 64] & (~std::uint64_t(0) >> (63 - k % 64)));
+                };
+
+                for (std::uint64_t i = 2; i <= c; i++)
+                    cross(i);
+                for (std::uint64_t b = c; b < a; b++)
+                {
+                    if (due[b] < high)
+                    {
+                        word    = 0;
+                        running = 0;
+                        bool prime = p[b + 1] * std::uint64_t(p[b + 1]) > y;
+                        do
+                        {
+                            std::int64_t n = before[b] + upto(due[b]);
+                            sum   += prime ? n : -mu[leaf[b]] * n;
+                            due[b] = following(b, leaf[b]);
+                        }
+                        while (due[b] < high);
+                    }
+                    before[b] += count;
+                    cross(b + 1);
+                }
+
+                // left: 1 and the primes above y
+                word    = 0;
+                running = 0;
+                for (; large > a; large--)
+                {
+                    std::uint64_t v = x / p[large];
+                    if (v >= high)
+                        break;
+                    p2 += left + upto(v) - 1 + std::int64_t(a);
+                }
+                left += count;
+                low   = high;
+            }
+
+            std::uint64_t b = p.size() - 1;
+            p2 -= std::int64_t((b * (b - 1) - a * (a - 1)) / 2);
+            return std::uint64_t(sum + std::int64_t(a) - 1 - p2);
+        }
+
+    private:
+        static const int small_a = 6;
+
+        // moves m of p[b + 1] down to the next special leaf, and returns its x / (m p[b + 1]);
+        // all ones when there is none left
+        std::uint64_t following(std::uint64_t b, std::uint64_t& m) const
+        {
+            std::uint64_t q = p[b + 1];
+            if (q * q > y)
+                return --m > b + 1 ? x / (q * p[m]) : ~std::uint64_t(0);
+            while (--m > y / q && (mu[m] == 0 || lpf[m] <= q))
+                ;
+            return m > y / q ? x / (q * m) : ~std::uint64_t(0);
+        }
+
+        std::int64_t phi_c(std::uint64_t v) const
+        {
+            return std::int64_t(v / product * totient + small[v % product]);
+        }
+
+        std::uint64_t               x, y, z;
+        std::vector<std::uint32_t>  p;
+        std::uint64_t               a, c;
+        std::uint32_t               product;
+        std::uint32_t               totient;
+        std::vector<std::uint16_t>  small;
+        std::vector<std::uint32_t>  lpf;
+        std::vector<std::int8_t>    mu;
+    };
+}
+
+inline bool isPrime(std::uint64_t n)
+{
+    int t = primality_detail::trial(n);
+    return t == 2 ? primality_detail::miller_rabin(n) : t == 1;
+}
+
+// out[i] = isPrime(n[i]); out may not overlap n
+inline void isPrime(const std::uint64_t* n, bool* out, std::size_t count)
+{
+    using namespace primality_detail;
+
+    // trial division settles most numbers; the rest take the base 2 test four at a time, and
+    // only the numbers that pass it go on to the other bases
+    std::uint64_t pending[4];
+    std::size_t   where[4];
+    int           waiting = 0;
+
+    auto finish = [&](int lanes)
+    {
+        bool passed[4];
+        if (lanes == 4)
+            base2_x4(pending, passed);
+        for (int k = 0; k < lanes; k++)
+        {
+            if (lanes < 4)
+                out[where[k]] = miller_rabin(pending[k]);
+            else
+                out[where[k]] = passed[k] && miller_rabin(pending[k], 1);
+        }
+    };
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        int t = trial(n[i]);
+        if (t != 2)
+        {
+            out[i] = t == 1;
+            continue;
+        }
+        pending[waiting] = n[i];
+        where[waiting]   = i;
+        if (++waiting == 4)
+        {
+            finish(4);
+            waiting = 0;
+        }
+    }
+    finish(waiting);
+}
+
+inline std::uint64_t primeCount(std::uint64_t x)
+{
+    if (x > std::uint64_t(100000000000000000))
+        throw std::out_of_range("primeCount: x must be at most 10^17");
+    // sieving is quicker below 10^6
+    if (x < 1000000)
+        return count_primes(0, x, 1);
+    return primality_detail::lmo(x).pi();
+}
+
+#endif
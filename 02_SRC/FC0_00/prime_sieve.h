@@ -0,0 +1,333 @@
+#ifndef PRIME_SIEVE_H
+#define PRIME_SIEVE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cpu_dispatch.h"
+
+/**
+ * Segmented Sieve of Eratosthenes over the odd numbers, one bit per odd number.
+ *
+ *  for_each_prime(lo, hi, f)    calls f(p) for every prime lo <= p <= hi, in increasing order
+ *  count_primes(lo, hi)         the number of primes lo <= p <= hi
+ *  prime_sieve(lo, hi)          the same primes one at a time: next(), or a range-for loop
+ *
+ * The range is sieved in segments of one L1 data cache (32 KiB, about half a million numbers),
+ * crossing off multiples of the primes up to sqrt(hi), so memory is bounded by the segments in
+ * flight plus those primes (40 KiB of them for hi = 10^10). for_each_prime and count_primes sieve
+ * a chunk of segments per thread; for_each_prime still calls f from the calling thread, in order.
+ * hi must be below 2^62; std::out_of_range is thrown otherwise.
+ */
+
+namespace sieve_detail
+{
+    const std::size_t segment_bits      = 32 * 1024 * 8;    // odd numbers per segment
+    const std::size_t segment_words     = segment_bits / 64;
+    const std::size_t segments_per_chunk = 32;              // per thread and round
+
+    inline std::uint64_t isqrt(std::uint64_t n)
+    {
+        std::uint64_t r = std::uint64_t(std::sqrt(double(n)));
+        while (r * r > n)
+            r--;
+        while ((r + 1) * (r + 1) <= n)
+            r++;
+        return r;
+    }
+
+    // the odd primes up to limit
+    inline std::vector<std::uint32_t> base_primes(std::uint64_t limit)
+    {
+        std::vector<std::uint32_t> primes;
+        std::vector<char> composite(limit / 2 + 1, 0);
+        for (std::uint64_t i = 3; i <= limit; i += 2)
+        {
+            if (composite[i / 2])
+                continue;
+            primes.push_back(std::uint32_t(i));
+            for (std::uint64_t m = i * i; m <= limit; m += 2 * i)
+                composite[m / 2] = 1;
+        }
+        return primes;
+    }
+
+    // bit k of words is set when lo + 2k is prime, for k < bits; lo is odd and at least 3
+    inline void sieve_segment(std::uint64_t lo, std::size_t bits, const std::vector<std::uint32_t>& primes,
+                              std::uint64_t* words)
+    {
+        std::size_t count = (bits + 63) / 64;
+        for (std::size_t w = 0; w < count; w++)
+            words[w] = ~std::uint64_t(0);
+        if (bits % 64)
+            words[count - 1] = (std::uint64_t(1) << (bits % 64)) - 1;
+
+        std::uint64_t end = lo + 2 * std::uint64_t(bits);
+        for (std::size_t i = 0; i < primes.size(); i++)
+        {
+            std::uint64_t p     = primes[i];
+            std::uint64_t start = p * p;
+            if (start >= end)
+                break;
+            if (start < lo)
+            {
+                // the first odd multiple of p in the segment
+                start = (lo + p - 1) / p * p;
+                if (start % 2 == 0)
+                    start += p;
+            }
+            for (std::uint64_t k = (start - lo) / 2; k < bits; k += p)
+                words[k / 64] &= ~(std::uint64_t(1) << (k % 64));
+        }
+    }
+
+    template <typename F> void emit(std::uint64_t lo, const std::uint64_t* words, std::size_t bits, F& f)
+    {
+        for (std::size_t w = 0; w < (bits + 63) / 64; w++)
+        {
+            for (std::uint64_t m = words[w]; m; m &= m - 1)
+                f(lo + 2 * (64 * std::uint64_t(w) + std::uint64_t(__builtin_ctzll(m))));
+        }
+    }
+
+    inline std::uint64_t popcount_scalar(const std::uint64_t* words, std::size_t bits)
+    {
+        std::uint64_t n = 0;
+        for (std::size_t w = 0; w < (bits + 63) / 64; w++)
+            n += std::uint64_t(__builtin_popcountll(words[w]));
+        return n;
+    }
+
+#if defined(CPU_DISPATCH_X86)
+    // the same loop, with one POPCNT per word instead of the bit tricks of the generic build
+    __attribute__((target("popcnt"))) inline std::uint64_t popcount_popcnt(const std::uint64_t* words, std::size_t bits)
+    {
+        std::uint64_t n = 0;
+        for (std::size_t w = 0; w < (bits + 63) / 64; w++)
+            n += std::uint64_t(__builtin_popcountll(words[w]));
+        return n;
+    }
+#endif
+
+    inline std::uint64_t popcount(const std::uint64_t* words, std::size_t bits)
+    {
+        typedef std::uint64_t (*fn)(const std::uint64_t*, std::size_t);
+#if defined(CPU_DISPATCH_X86)
+        static const fn kernel = select_kernel<fn>(popcount_scalar, popcount_popcnt, 0, 0);
+#else
+        static const fn kernel = popcount_scalar;
+#endif
+        return kernel(words, bits);
+    }
+
+    // the odd numbers of [lo, hi], split into segments
+    struct odd_range
+    {
+        std::uint64_t   first;      // the first odd number >= 3 in range
+        std::uint64_t   odds;       // how many odd numbers from first to hi; 0 when empty
+        std::uint64_t   segments;
+
+        odd_range(std::uint64_t lo, std::uint64_t hi)
+        {
+            first    = lo < 3 ? 3 : lo | 1;
+            odds     = first <= hi ? (hi - first) / 2 + 1 : 0;
+            segments = (odds + segment_bits - 1) / segment_bits;
+        }
+
+        std::uint64_t segment_lo(std::uint64_t s) const     { return first + 2 * s * segment_bits; }
+        std::size_t   segment_size(std::uint64_t s) const
+        {
+            std::uint64_t left = odds - s * segment_bits;
+            return std::size_t(left < segment_bits ? left : segment_bits);
+        }
+    };
+
+    // sieves segments [from, from + count) into words, one after the other
+    inline void sieve_chunk(const odd_range& r, std::uint64_t from, std::uint64_t count,
+                            const std::vector<std::uint32_t>& primes, std::uint64_t* words)
+    {
+        for (std::uint64_t s = 0; s < count; s++)
+            sieve_segment(r.segment_lo(from + s), r.segment_size(from + s), primes, words + s * segment_words);
+    }
+
+    // the odd-number arithmetic of odd_range and sieve_segment needs the headroom
+    inline void check_range(std::uint64_t hi)
+    {
+        if (hi >= std::uint64_t(1) << 62)
+            throw std::out_of_range("prime sieve: hi must be below 2^62");
+    }
+
+    inline unsigned thread_count(unsigned threads, std::uint64_t chunks)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+        return chunks < threads ? unsigned(chunks) : threads;
+    }
+}
+
+// threads == 0 uses every hardware thread
+template <typename F> void for_each_prime(std::uint64_t lo, std::uint64_t hi, F f, unsigned threads = 0)
+{
+    using namespace sieve_detail;
+
+    check_range(hi);
+    if (lo <= 2 && 2 <= hi)
+        f(std::uint64_t(2));
+
+    odd_range r(lo, hi);
+    if (r.odds == 0)
+        return;
+
+    std::vector<std::uint32_t> primes = base_primes(isqrt(hi));
+    std::uint64_t chunks = (r.segments + segments_per_chunk - 1) / segments_per_chunk;
+    threads = thread_count(threads, chunks);
+
+    std::size_t chunk_words = segments_per_chunk * segment_words;
+    std::vector<std::uint64_t> words(threads * chunk_words), segment(threads), count(threads);
+    for (std::uint64_t c = 0; c < chunks; c += threads)
+    {
+        // sieve one chunk per thread, then hand out the primes in order
+        unsigned round = unsigned(chunks - c < threads ? chunks - c : threads);
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < round; t++)
+        {
+            segment[t] = (c + t) * segments_per_chunk;
+            count[t]   = r.segments - segment[t] < segments_per_chunk ? r.segments - segment[t] : segments_per_chunk;
+        }
+        for (unsigned t = 1; t < round; t++)
+        {
+            std::uint64_t* out = &words[t * chunk_words];
+            pool.push_back(std::thread([&, t, out]() { sieve_chunk(r, segment[t], count[t], primes, out); }));
+        }
+        sieve_chunk(r, segment[0], count[0], primes, &words[0]);
+        for (std::size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+
+        for (unsigned t = 0; t < round; t++)
+        {
+            for (std::uint64_t s = 0; s < count[t]; s++)
+                emit(r.segment_lo(segment[t] + s), &words[t * chunk_words + s * segment_words],
+                     r.segment_size(segment[t] + s), f);
+        }
+    }
+}
+
+inline std::uint64_t count_primes(std::uint64_t lo, std::uint64_t hi, unsigned threads = 0)
+{
+    using namespace sieve_detail;
+
+    check_range(hi);
+    std::uint64_t total = lo <= 2 && 2 <= hi ? 1 : 0;
+    odd_range r(lo, hi);
+    if (r.odds == 0)
+        return total;
+
+    std::vector<std::uint32_t> primes = base_primes(isqrt(hi));
+    threads = thread_count(threads, r.segments);
+
+    // thread t takes segments t, t + threads, t + 2 threads, ...
+    std::vector<std::uint64_t> found(threads, 0);
+    std::vector<std::thread> pool;
+    auto work = [&](unsigned t)
+    {
+        std::vector<std::uint64_t> words(segment_words);
+        for (std::uint64_t s = t; s < r.segments; s += threads)
+        {
+            sieve_segment(r.segment_lo(s), r.segment_size(s), primes, words.data());
+            found[t] += popcount(words.data(), r.segment_size(s));
+        }
+    };
+    for (unsigned t = 1; t < threads; t++)
+        pool.push_back(std::thread(work, t));
+    work(0);
+    for (std::size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    for (unsigned t = 0; t < threads; t++)
+        total += found[t];
+    return total;
+}
+
+// the primes of [lo, hi] one at a time, sieving one segment ahead on the calling thread
+class prime_sieve
+{
+public:
+    prime_sieve(std::uint64_t lo, std::uint64_t hi)
+        : range(lo, hi), two(lo <= 2 && 2 <= hi), segment(0), word(0), bits(0), mask(0)
+    {
+        sieve_detail::check_range(hi);
+        if (range.odds)
+        {
+            primes = sieve_detail::base_primes(sieve_detail::isqrt(hi));
+            words.resize(sieve_detail::segment_words);
+        }
+    }
+
+    // the next prime into p, or false when there are no more
+    bool next(std::uint64_t& p)
+    {
+        if (two)
+        {
+            two = false;
+            p   = 2;
+            return true;
+        }
+        while (mask == 0)
+        {
+            if (++word * 64 >= bits && !load())
+                return false;
+            mask = words[word];
+        }
+        p    = range.segment_lo(segment - 1) + 2 * (64 * std::uint64_t(word) + std::uint64_t(__builtin_ctzll(mask)));
+        mask &= mask - 1;
+        return true;
+    }
+
+    class iterator
+    {
+    public:
+        iterator(prime_sieve* s) : sieve(s), p(0)   { ++*this; }
+
+        std::uint64_t   operator * () const                 { return p; }
+        iterator&       operator ++ ()                      { if (sieve && !sieve->next(p)) sieve = 0; return *this; }
+        bool            operator != (const iterator& o) const { return sieve != o.sieve; }
+        bool            operator == (const iterator& o) const { return sieve == o.sieve; }
+
+    private:
+        prime_sieve*    sieve;
+        std::uint64_t   p;
+    };
+
+    iterator begin()    { return iterator(this); }
+    iterator end()      { return iterator(0); }
+
+private:
+    bool load()
+    {
+        if (segment >= range.segments)
+            return false;
+        bits = range.segment_size(segment);
+        sieve_detail::sieve_segment(range.segment_lo(segment), bits, primes, words.data());
+        segment++;
+        word = 0;
+        mask = 0;
+        return true;
+    }
+
+    sieve_detail::odd_range         range;
+    bool                            two;
+    std::vector<std::uint32_t>      primes;
+    std::vector<std::uint64_t>      words;
+    std::uint64_t                   segment;    // segments loaded so far
+    std::size_t                     word;
+    std::size_t                     bits;       // in the loaded segment
+    std::uint64_t                   mask;       // bits of words[word] not returned yet
+};
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef SCAN_OPS_H
+#define SCAN_OPS_H
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+#include "prefix_scan.h"
+
+/**
+ * Scans with any associative operator, and segmented scans, on the backend of prefix_scan.h:
+ *
+ *  prefix_scan(a, c, n, op)             c[j] = a[0] op a[1] op ... op a[j]
+ *  segmented_scan(a, flags, c, n, op)   the same, started again at every j with flags[j] != 0
+ *  segmented_sum(a, flags, c, n)        segmented_scan() with scan_plus
+ *  segment_starts(keys, flags, n)       flags for a sorted key column, e.g. account numbers
+ *
+ * An operator is a functor with T operator()(T, T) const and T identity() const: scan_plus,
+ * scan_max, scan_min and scan_product below, or make_scan_op(f, identity) for any other
+ * function. It must be associative, because blocks are scanned on separate threads, but it
+ * does not have to be commutative.
+ *
+ * The four operators above are scanned in SIMD registers for double (segmented scans only at
+ * cpu_avx2 and above, see cpu_dispatch.h), and scan_plus goes through prefix_sum() for every
+ * type. Other operators and types use a scalar loop per block, still split over threads.
+ */
+
+template <typename T> struct scan_plus
+{
+    T identity() const                  { return T(); }
+    T operator()(T x, T y) const        { return x + y; }
+};
+
+template <typename T> struct scan_max
+{
+    T identity() const
+    {
+        return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                    : std::numeric_limits<T>::lowest();
+    }
+    T operator()(T x, T y) const        { return y > x ? y : x; }
+};
+
+template <typename T> struct scan_min
+{
+    T identity() const
+    {
+        return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                    : std::numeric_limits<T>::max();
+    }
+    T operator()(T x, T y) const        { return y < x ? y : x; }
+};
+
+template <typename T> struct scan_product
+{
+    T identity() const                  { return T(1); }
+    T operator()(T x, T y) const        { return x * y; }
+};
+
+template <typename T, typename F> struct scan_op
+{
+    F f;
+    T id;
+
+    T identity() const                  { return id; }
+    T operator()(T x, T y) const        { return f(x, y); }
+};
+
+template <typename T, typename F> scan_op<T, F> make_scan_op(F f, T identity)
+{
+    scan_op<T, F> op = { f, identity };
+    return op;
+}
+
+namespace scan_detail
+{
+    // the operators with a SIMD form for double; apply(x, y) is op(x, y) in every lane
+    template <typename Op> struct simd_op
+    {
+        static const bool enabled = false;
+    };
+
+#if defined(__SSE2__)
+    template <> struct simd_op<scan_plus<double> >
+    {
+        static const bool enabled = true;
+        static __m128d apply(__m128d x, __m128d y)      { return _mm_add_pd(x, y); }
+        __attribute__((target("avx2")))
+        static __m256d apply(__m256d x, __m256d y)      { return _mm256_add_pd(x, y); }
+    };
+
+    // maxpd and minpd return their second operand on NaN, like the scalar operators
+    template <> struct simd_op<scan_max<double> >
+    {
+        static const bool enabled = true;
+        static __m128d apply(__m128d x, __m128d y)      { return _mm_max_pd(y, x); }
+        __attribute__((target("avx2")))
+        static __m256d apply(__m256d x, __m256d y)      { return _mm256_max_pd(y, x); }
+    };
+
+    template <> struct simd_op<scan_min<double> >
+    {
+        static const bool enabled = true;
+        static __m128d apply(__m128d x, __m128d y)      { return _mm_min_pd(y, x); }
+        __attribute__((target("avx2")))
+        static __m256d apply(__m256d x, __m256d y)      { return _mm256_min_pd(y, x); }
+    };
+
+    template <> struct simd_op<scan_product<double> >
+    {
+        static const bool enabled = true;
+        static __m128d apply(__m128d x, __m128d y)      { return _mm_mul_pd(x, y); }
+        __attribute__((target("avx2")))
+        static __m256d apply(__m256d x, __m256d y)      { return _mm256_mul_pd(x, y); }
+    };
+#endif
+
+    template <typename T, typename Op> T scan_op_serial(const Op& op, const T* a, T* c, std::size_t n, T carry)
+    {
+        for (std::size_t j = 0; j < n; j++)
+        {
+            carry = op(carry, a[j]);
+            c[j]  = carry;
+        }
+        return carry;
+    }
+
+    template <typename T, typename Op>
+    T scan_segmented_serial(const Op& op, const T* a, const unsigned char* flags, T* c, std::size_t n, T carry)
+    {
+        for (std::size_t j = 0; j < n; j++)
+        {
+            carry = flags[j] ? a[j] : op(carry, a[j]);
+            c[j]  = carry;
+        }
+        return carry;
+    }
+
+    // the shift-and-combine scan of scan_block<double>, with the identity shifted in
+#if defined(__SSE2__)
+    template <typename Op> double scan_op_sse2(const Op& op, const double* a, double* c, std::size_t n, double carry)
+    {
+        std::size_t j    = 0;
+        __m128d id       = _mm_set1_pd(op.identity());
+        __m128d total    = _mm_set1_pd(carry);
+        for (; j + 2 <= n; j += 2)
+        {
+            __m128d x = _mm_loadu_pd(a + j);
+            x = simd_op<Op>::apply(_mm_shuffle_pd(id, x, 0x0), x);
+            x = simd_op<Op>::apply(total, x);
+            _mm_storeu_pd(c + j, x);
+            total = _mm_unpackhi_pd(x, x);
+        }
+        return scan_op_serial(op, a + j, c + j, n - j, _mm_cvtsd_f64(total));
+    }
+
+    template <typename Op>
+    __attribute__((target("avx2"))) double scan_op_avx2(const Op& op, const double* a, double* c, std::size_t n,
+                                                        double carry)
+    {
+        std::size_t j    = 0;
+        __m256d id       = _mm256_set1_pd(op.identity());
+        __m256d total    = _mm256_set1_pd(carry);
+        for (; j + 4 <= n; j += 4)
+        {
+            __m256d x = _mm256_loadu_pd(a + j);
+            x = simd_op<Op>::apply(_mm256_blend_pd(_mm256_permute4x64_pd(x, 0x90), id, 0x1), x);
+            x = simd_op<Op>::apply(_mm256_blend_pd(_mm256_permute4x64_pd(x, 0x40), id, 0x3), x);
+            x = simd_op<Op>::apply(total, x);
+            _mm256_storeu_pd(c + j, x);
+            total = _mm256_permute4x64_pd(x, 0xFF);
+        }
+        return scan_op_serial(op, a + j, c + j, n - j, _mm256_cvtsd_f64(total));
+    }
+
+    // as above, but a lane only takes from the lanes before it up to the nearest flag; f holds
+    // all ones in the lanes that have seen a flag so far
+    template <typename Op>
+    __attribute__((target("avx2"))) double scan_segmented_avx2(const Op& op, const double* a, const unsigned char* flags,
+                                                               double* c, std::size_t n, double carry)
+    {
+        std::size_t j    = 0;
+        __m256d none     = _mm256_setzero_pd();
+        __m256d id       = _mm256_set1_pd(op.identity());
+        __m256d total    = _mm256_set1_pd(carry);
+        for (; j + 4 <= n; j += 4)
+        {
+            int bits;
+            std::memcpy(&bits, flags + j, 4);
+            __m256i wide = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bits));
+            __m256d f    = _mm256_castsi256_pd(_mm256_cmpgt_epi64(wide, _mm256_setzero_si256()));
+
+            __m256d x = _mm256_loadu_pd(a + j);
+            x = _mm256_blendv_pd(simd_op<Op>::apply(_mm256_blend_pd(_mm256_permute4x64_pd(x, 0x90), id, 0x1), x), x, f);
+            f = _mm256_or_pd(f, _mm256_blend_pd(_mm256_permute4x64_pd(f, 0x90), none, 0x1));
+            x = _mm256_blendv_pd(simd_op<Op>::apply(_mm256_blend_pd(_mm256_permute4x64_pd(x, 0x40), id, 0x3), x), x, f);
+            f = _mm256_or_pd(f, _mm256_blend_pd(_mm256_permute4x64_pd(f, 0x40), none, 0x3));
+            x = _mm256_blendv_pd(simd_op<Op>::apply(total, x), x, f);
+            _mm256_storeu_pd(c + j, x);
+            total = _mm256_permute4x64_pd(x, 0xFF);
+        }
+        return scan_segmented_serial(op, a + j, flags + j, c + j, n - j, _mm256_cvtsd_f64(total));
+    }
+#endif
+
+    template <typename T, typename Op> T scan_op_block(const Op& op, const T* a, T* c, std::size_t n, T carry)
+    {
+#if defined(__SSE2__)
+        if constexpr (std::is_same<T, double>::value && simd_op<Op>::enabled)
+        {
+            if (active_cpu_level() >= cpu_avx2)
+                return scan_op_avx2(op, a, c, n, carry);
+            if (active_cpu_level() >= cpu_sse42)
+                return scan_op_sse2(op, a, c, n, carry);
+        }
+#endif
+        return scan_op_serial(op, a, c, n, carry);
+    }
+
+    template <typename T, typename Op>
+    T scan_segmented_block(const Op& op, const T* a, const unsigned char* flags, T* c, std::size_t n, T carry)
+    {
+#if defined(__SSE2__)
+        if constexpr (std::is_same<T, double>::value && simd_op<Op>::enabled)
+        {
+            if (active_cpu_level() >= cpu_avx2)
+                return scan_segmented_avx2(op, a, flags, c, n, carry);
+        }
+#endif
+        return scan_segmented_serial(op, a, flags, c, n, carry);
+    }
+
+    template <typename T, typename Op> struct op_kernel
+    {
+        typedef T carry_type;
+
+        Op op;
+
+        T identity() const                                          { return op.identity(); }
+        T combine(T x, T y) const                                   { return op(x, y); }
+        T scan(const T* a, T* c, std::size_t n, T carry) const      { return scan_op_block(op, a, c, n, carry); }
+        T reduce(const T* a, std::size_t n) const
+        {
+            T r = op.identity();
+            for (std::size_t j = 0; j < n; j++)
+                r = op(r, a[j]);
+            return r;
+        }
+    };
+
+    // the total of a block of a segmented scan: the value since its last flag, and whether it
+    // has one, in which case nothing before the block reaches past it
+    template <typename T> struct segment_carry
+    {
+        T       value;
+        bool    flagged;
+    };
+
+    // the kernel gets pointers into a; base and flags find the flags that go with them
+    template <typename T, typename Op> struct segmented_kernel
+    {
+        typedef segment_carry<T> carry_type;
+
+        Op                      op;
+        const T*                base;
+        const unsigned char*    flags;
+
+        carry_type identity() const
+        {
+            carry_type r = { op.identity(), false };
+            return r;
+        }
+        carry_type combine(carry_type x, carry_type y) const
+        {
+            if (y.flagged)
+                return y;
+            carry_type r = { op(x.value, y.value), x.flagged };
+            return r;
+        }
+        carry_type reduce(const T* a, std::size_t n) const
+        {
+            const unsigned char* f = flags + (a - base);
+            std::size_t from = n;
+            while (from > 0 && !f[from - 1])
+                from--;
+
+            carry_type r = identity();
+            if (from > 0)
+            {
+                r.value   = a[from - 1];
+                r.flagged = true;
+            }
+            for (std::size_t j = from; j < n; j++)
+                r.value = op(r.value, a[j]);
+            return r;
+        }
+        carry_type scan(const T* a, T* c, std::size_t n, carry_type carry) const
+        {
+            carry.value = scan_segmented_block(op, a, flags + (a - base), c, n, carry.value);
+            return carry;
+        }
+    };
+}
+
+// threads == 0 uses every hardware thread for arrays large enough to benefit; c may be a
+template <typename T, typename Op> void prefix_scan(const T* a, T* c, std::size_t n, Op op, unsigned threads = 0)
+{
+    if constexpr (std::is_same<Op, scan_plus<T> >::value)
+    {
+        prefix_sum(a, c, n, threads);
+    }
+    else
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+
+        scan_detail::op_kernel<T, Op> k = { op };
+        if (threads > 1 && n >= scan_detail::parallel_threshold)
+            scan_detail::scan_parallel(k, a, c, n, threads);
+        else
+            k.scan(a, c, n, k.identity());
+    }
+}
+
+// flags[j] != 0 starts a new segment at j; the first element always starts one
+template <typename T, typename Op>
+void segmented_scan(const T* a, const unsigned char* flags, T* c, std::size_t n, Op op, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+
+    scan_detail::segmented_kernel<T, Op> k = { op, a, flags };
+    if (threads > 1 && n >= scan_detail::parallel_threshold)
+        scan_detail::scan_parallel(k, a, c, n, threads);
+    else
+        k.scan(a, c, n, k.identity());
+}
+
+template <typename T> void segmented_sum(const T* a, const unsigned char* flags, T* c, std::size_t n, unsigned threads = 0)
+{
+    segmented_scan(a, flags, c, n, scan_plus<T>(), threads);
+}
+
+// flags[j] = 1 where keys[j] differs from keys[j - 1], for a column sorted by key
+template <typename K> void segment_starts(const K* keys, unsigned char* flags, std::size_t n)
+{
+    for (std::size_t j = 0; j < n; j++)
+        flags[j] = j == 0 || !(keys[j] == keys[j - 1]);
+}
+
+#endif
@@ -3,6 +3,7 @@
 //#include <math.h> // This one for c and I didn't use it here
 #include <cmath> // This one for c++ and I used it for pow() function
 //#include <stdio.h>   // This is for C-language only
+#include "../FC0_00/async_log.h"   // log_push(), the asynchronous backend of Log()
 using namespace std;
 
 int add(int x, int y)
@@ -37,7 +38,9 @@ int USING_IF(int x)
 }
 void Log(const char* message)
 {
-
+    // one record for the background writer once log_start() has been called
+    if (log_push({ message, "\n" }))
+        return;
     std::cout << message << std::endl;
 
 }
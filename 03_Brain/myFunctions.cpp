@@ -8,11 +8,11 @@
 
 
 #include "myFunctions.hpp"
+#include "reductions.hpp"
+#include "rng.hpp"
 #include <iostream>
 #include <string>
 #include <cstdio>
-#include <cstdlib>          // for rand()
-#include <ctime>            // for srand(time)
 
 
 
@@ -21,9 +21,10 @@ int Gfunc(int a, int b){
     return a+b;
 }
 
-// to return the average of three integers
+// to return the average of three integers; Mean() in reductions.hpp does any number of them
 double GAverage(double a , double b, double c){
-    return (a+b+c)/3;
+    double values[3] = {a, b, c};
+    return Mean(values, 3, 1);
 }
 
 
@@ -91,20 +92,17 @@ void Brain() {
     }
 }
 
+// one of 0.01, 0.02, ..., 1.00, from the calling thread's generator in rng.hpp
 double Guessing(){
-    //std::srand((unsigned)time(0));
-    double random_number = std::rand();
-    random_number = (static_cast<int>(random_number) % 100 + 1)/100.0 ; //very important to create 100.0 rather than int 100
-    //std::cout << random_number << std::endl;
-    return random_number;
+    return (RandomBounded(100) + 1)/100.0 ; //very important to create 100.0 rather than int 100
 }
 
 int guessingInt(){
     /**
         This is a function to guess a number between two int values max and min
-              -->  int randNum = rand()%(max-min + 1) + min;
+              -->  int randNum = RandomBounded(max-min + 1) + min;
      */
-    int randNum = std::rand()%(9-1 + 1) + 1;
+    int randNum = int(RandomBounded(9-1 + 1)) + 1;
     return randNum;
 }
 
@@ -0,0 +1,354 @@
+//
+//  reductions.cpp
+//  TestingGh
+//
+
+#include "reductions.hpp"
+#include "../02_SRC/FC0_00/cpu_dispatch.h"
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// below this many values one thread is faster than starting more
+const std::size_t parallelThreshold = std::size_t(1) << 20;
+// RunningStats::push(x, n) works in blocks of this many values, which stay in L1 for the second pass
+const std::size_t blockSize = 2048;
+
+// the kernels: sum, min and max, and the sum of squared distances from a mean. Independent
+// accumulators, so the adds do not wait on one another; the tail is added last, in order,
+// so that a few values sum exactly like the plain loop (GAverage relies on it).
+double sumScalar(const double* x, std::size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    double s = (s0 + s1) + (s2 + s3);
+    for (; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+void minMaxScalar(const double* x, std::size_t n, double& lo, double& hi)
+{
+    for (std::size_t i = 0; i < n; i++){
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+    }
+}
+
+double squaresScalar(const double* x, std::size_t n, double mean)
+{
+    double s0 = 0, s1 = 0;
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2){
+        s0 += (x[i] - mean) * (x[i] - mean);
+        s1 += (x[i + 1] - mean) * (x[i + 1] - mean);
+    }
+    double s = s0 + s1;
+    for (; i < n; i++)
+        s += (x[i] - mean) * (x[i] - mean);
+    return s;
+}
+
+#if defined(__SSE2__)
+// minpd and maxpd return their second operand when either is NaN, so NaNs are skipped like
+// in the scalar comparisons
+double sumSse2(const double* x, std::size_t n)
+{
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(x + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(x + i + 2));
+        s2 = _mm_add_pd(s2, _mm_loadu_pd(x + i + 4));
+        s3 = _mm_add_pd(s3, _mm_loadu_pd(x + i + 6));
+    }
+    __m128d s = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+    double total = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    for (; i < n; i++)
+        total += x[i];
+    return total;
+}
+
+void minMaxSse2(const double* x, std::size_t n, double& lo, double& hi)
+{
+    __m128d l0 = _mm_set1_pd(lo), l1 = l0;
+    __m128d h0 = _mm_set1_pd(hi), h1 = h0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128d a = _mm_loadu_pd(x + i);
+        __m128d b = _mm_loadu_pd(x + i + 2);
+        l0 = _mm_min_pd(a, l0);
+        l1 = _mm_min_pd(b, l1);
+        h0 = _mm_max_pd(a, h0);
+        h1 = _mm_max_pd(b, h1);
+    }
+    l0 = _mm_min_pd(l0, l1);
+    h0 = _mm_max_pd(h0, h1);
+    lo = _mm_cvtsd_f64(_mm_min_sd(l0, _mm_unpackhi_pd(l0, l0)));
+    hi = _mm_cvtsd_f64(_mm_max_sd(h0, _mm_unpackhi_pd(h0, h0)));
+    minMaxScalar(x + i, n - i, lo, hi);
+}
+
+double squaresSse2(const double* x, std::size_t n, double mean)
+{
+    __m128d m = _mm_set1_pd(mean);
+    __m128d s0 = _mm_setzero_pd(), s1 = s0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128d a = _mm_sub_pd(_mm_loadu_pd(x + i), m);
+        __m128d b = _mm_sub_pd(_mm_loadu_pd(x + i + 2), m);
+        s0 = _mm_add_pd(s0, _mm_mul_pd(a, a));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(b, b));
+    }
+    __m128d s = _mm_add_pd(s0, s1);
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s))) + squaresScalar(x + i, n - i, mean);
+}
+
+__attribute__((target("avx2"))) double sumAvx2(const double* x, std::size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16){
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(x + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(x + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(x + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(x + i + 12));
+    }
+    __m256d s4 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(s4), _mm256_extractf128_pd(s4, 1));
+    double total = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    for (; i < n; i++)
+        total += x[i];
+    return total;
+}
+
+__attribute__((target("avx2"))) void minMaxAvx2(const double* x, std::size_t n, double& lo, double& hi)
+{
+    __m256d l0 = _mm256_set1_pd(lo), l1 = l0;
+    __m256d h0 = _mm256_set1_pd(hi), h1 = h0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256d a = _mm256_loadu_pd(x + i);
+        __m256d b = _mm256_loadu_pd(x + i + 4);
+        l0 = _mm256_min_pd(a, l0);
+        l1 = _mm256_min_pd(b, l1);
+        h0 = _mm256_max_pd(a, h0);
+        h1 = _mm256_max_pd(b, h1);
+    }
+    l0 = _mm256_min_pd(l0, l1);
+    h0 = _mm256_max_pd(h0, h1);
+    __m128d l = _mm_min_pd(_mm256_castpd256_pd128(l0), _mm256_extractf128_pd(l0, 1));
+    __m128d h = _mm_max_pd(_mm256_castpd256_pd128(h0), _mm256_extractf128_pd(h0, 1));
+    lo = _mm_cvtsd_f64(_mm_min_sd(l, _mm_unpackhi_pd(l, l)));
+    hi = _mm_cvtsd_f64(_mm_max_sd(h, _mm_unpackhi_pd(h, h)));
+    minMaxScalar(x + i, n - i, lo, hi);
+}
+
+__attribute__((target("avx2"))) double squaresAvx2(const double* x, std::size_t n, double mean)
+{
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256d a = _mm256_sub_pd(_mm256_loadu_pd(x + i), m);
+        __m256d b = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4), m);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(a, a));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(b, b));
+    }
+    __m256d s2 = _mm256_add_pd(s0, s1);
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(s2), _mm256_extractf128_pd(s2, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s))) + squaresScalar(x + i, n - i, mean);
+}
+#endif
+
+struct Kernels
+{
+    double (*sum)(const double*, std::size_t);
+    void (*minMax)(const double*, std::size_t, double&, double&);
+    double (*squares)(const double*, std::size_t, double);
+};
+
+Kernels scalarKernels()
+{
+    Kernels k = { sumScalar, minMaxScalar, squaresScalar };
+    return k;
+}
+
+#if defined(__SSE2__)
+Kernels sse2Kernels()
+{
+    Kernels k = { sumSse2, minMaxSse2, squaresSse2 };
+    return k;
+}
+
+Kernels avx2Kernels()
+{
+    Kernels k = { sumAvx2, minMaxAvx2, squaresAvx2 };
+    return k;
+}
+#endif
+
+// the kernels for active_cpu_level(), so CPU_LEVEL picks them like every other kernel (cpu_dispatch.h);
+// the SSE2 ones stand in for the sse4.2 level
+const Kernels& kernels()
+{
+#if defined(__SSE2__)
+    static const Kernels k = select_kernel<Kernels (*)()>(scalarKernels, sse2Kernels, avx2Kernels, 0)();
+#else
+    static const Kernels k = scalarKernels();
+#endif
+    return k;
+}
+
+unsigned threadCount(unsigned threads, std::size_t n)
+{
+    if (threads == 0)
+        threads = n >= parallelThreshold ? std::thread::hardware_concurrency() : 1;
+    if (threads == 0)
+        threads = 1;
+    return n < threads ? unsigned(n > 0 ? n : 1) : threads;
+}
+
+// f(x + from, len) over one slice per thread, folded with combine in slice order
+template <typename R, typename F, typename Combine>
+R overThreads(const double* x, std::size_t n, unsigned threads, F f, Combine combine)
+{
+    threads = threadCount(threads, n);
+    if (threads == 1)
+        return f(x, n);
+
+    std::size_t slice = (n + threads - 1) / threads;
+    std::vector<R> results(threads);
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++){
+        std::size_t from = t * slice < n ? t * slice : n;
+        std::size_t len  = from + slice < n ? slice : n - from;
+        pool.push_back(std::thread([=, &results]() { results[t] = f(x + from, len); }));
+    }
+    results[0] = f(x, slice);
+    for (std::size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    R r = results[0];
+    for (unsigned t = 1; t < threads; t++)
+        r = combine(r, results[t]);
+    return r;
+}
+
+}
+
+RunningStats::RunningStats()
+    : n(0), m(0), m2(0), lo(std::numeric_limits<double>::infinity()), hi(-std::numeric_limits<double>::infinity())
+{
+}
+
+void RunningStats::push(double x)
+{
+    n++;
+    double delta = x - m;
+    m  += delta / n;
+    m2 += delta * (x - m);
+    lo = x < lo ? x : lo;
+    hi = x > hi ? x : hi;
+}
+
+void RunningStats::push(const double* x, std::size_t count)
+{
+    const Kernels& k = kernels();
+    for (std::size_t i = 0; i < count; i += blockSize){
+        // two passes over a block that is still in L1: its mean, then the squares around it
+        RunningStats block;
+        block.n  = count - i < blockSize ? count - i : blockSize;
+        block.m  = k.sum(x + i, block.n) / block.n;
+        block.m2 = k.squares(x + i, block.n, block.m);
+        k.minMax(x + i, block.n, block.lo, block.hi);
+        merge(block);
+    }
+}
+
+void RunningStats::merge(const RunningStats& other)
+{
+    if (other.n == 0)
+        return;
+    if (n == 0){
+        *this = other;
+        return;
+    }
+    double total = double(n) + double(other.n);
+    double delta = other.m - m;
+    m  += delta * (double(other.n) / total);
+    m2 += other.m2 + delta * delta * (double(n) * double(other.n) / total);
+    n  += other.n;
+    lo = other.lo < lo ? other.lo : lo;
+    hi = other.hi > hi ? other.hi : hi;
+}
+
+double RunningStats::mean() const
+{
+    return n ? m : std::numeric_limits<double>::quiet_NaN();
+}
+
+double RunningStats::variance() const
+{
+    return n ? m2 / n : std::numeric_limits<double>::quiet_NaN();
+}
+
+double Sum(const double* x, std::size_t n, unsigned threads)
+{
+    return overThreads<double>(x, n, threads,
+                               [](const double* p, std::size_t len) { return kernels().sum(p, len); },
+                               [](double a, double b) { return a + b; });
+}
+
+double Mean(const double* x, std::size_t n, unsigned threads)
+{
+    return Sum(x, n, threads) / n;
+}
+
+RunningStats Summary(const double* x, std::size_t n, unsigned threads)
+{
+    return overThreads<RunningStats>(x, n, threads,
+                                     [](const double* p, std::size_t len) { RunningStats s; s.push(p, len); return s; },
+                                     [](RunningStats a, const RunningStats& b) { a.merge(b); return a; });
+}
+
+double Variance(const double* x, std::size_t n, unsigned threads)
+{
+    return Summary(x, n, threads).variance();
+}
+
+double Min(const double* x, std::size_t n, unsigned threads)
+{
+    return overThreads<double>(x, n, threads,
+                               [](const double* p, std::size_t len)
+                               {
+                                   double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+                                   kernels().minMax(p, len, lo, hi);
+                                   return lo;
+                               },
+                               [](double a, double b) { return b < a ? b : a; });
+}
+
+double Max(const double* x, std::size_t n, unsigned threads)
+{
+    return overThreads<double>(x, n, threads,
+                               [](const double* p, std::size_t len)
+                               {
+                                   double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+                                   kernels().minMax(p, len, lo, hi);
+                                   return hi;
+                               },
+                               [](double a, double b) { return b > a ? b : a; });
+}
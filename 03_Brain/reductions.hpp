@@ -0,0 +1,57 @@
+//
+//  reductions.hpp
+//  TestingGh
+//
+//  Statistics over arrays of doubles, the general form of GAverage():
+//
+//      Sum, Mean, Variance, Min, Max   one value over x[0] ... x[n-1]
+//      Summary                         all of them in one pass, as a RunningStats
+//      RunningStats                    the same for data that arrives a value or a block at a time
+//
+//  The blocks are summed with several SIMD accumulators (AVX2 when the CPU has it, SSE2
+//  otherwise, picked by active_cpu_level() so CPU_LEVEL can force the narrower ones, see
+//  02_SRC/FC0_00/cpu_dispatch.h), so a long array is read at memory speed. threads == 0 splits arrays of a million
+//  values or more over every hardware thread; threads == 1 stays on the calling thread.
+//  Variance is the population variance (divided by n), from Welford's update and the pairwise
+//  merge of Chan et al., so it stays accurate when the mean is large next to the spread.
+//  Build with -pthread.
+//
+
+#ifndef reductions_hpp
+#define reductions_hpp
+#include <cstddef>
+
+class RunningStats
+{
+public:
+    RunningStats();
+
+    // Welford's update for one value
+    void push(double x);
+    // a block of values, through the SIMD kernels
+    void push(const double* x, std::size_t n);
+    // as if every value pushed into other had been pushed here
+    void merge(const RunningStats& other);
+
+    std::size_t count() const       { return n; }
+    double mean() const;            // NaN when empty
+    double variance() const;        // NaN when empty
+    double min() const              { return lo; }      // +infinity when empty
+    double max() const              { return hi; }      // -infinity when empty
+
+private:
+    std::size_t n;
+    double m;       // mean so far
+    double m2;      // sum of squared distances from m
+    double lo;
+    double hi;
+};
+
+double Sum(const double* x, std::size_t n, unsigned threads = 0);
+double Mean(const double* x, std::size_t n, unsigned threads = 0);
+double Variance(const double* x, std::size_t n, unsigned threads = 0);
+double Min(const double* x, std::size_t n, unsigned threads = 0);
+double Max(const double* x, std::size_t n, unsigned threads = 0);
+RunningStats Summary(const double* x, std::size_t n, unsigned threads = 0);
+
+#endif /* reductions_hpp */
@@ -0,0 +1,106 @@
+//
+//  rng.cpp
+//  TestingGh
+//
+
+#include "rng.hpp"
+#include <mutex>
+
+namespace {
+
+std::uint64_t splitMix64(std::uint64_t& x)
+{
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// where the next thread's stream starts; any fixed seed would do, this one is the default
+// seed of std::rand()
+std::mutex masterLock;
+Xoshiro256 master(1);
+
+Xoshiro256 nextStream()
+{
+    std::lock_guard<std::mutex> hold(masterLock);
+    Xoshiro256 stream = master;
+    master.jump();
+    return stream;
+}
+
+Xoshiro256& threadGenerator()
+{
+    thread_local Xoshiro256 generator = nextStream();
+    return generator;
+}
+
+}
+
+Xoshiro256::Xoshiro256(std::uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+        s[i] = splitMix64(seed);
+}
+
+void Xoshiro256::jump()
+{
+    static const std::uint64_t polynomial[] = {
+        0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+    std::uint64_t t[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++){
+        for (int b = 0; b < 64; b++){
+            if (polynomial[i] & (std::uint64_t(1) << b)){
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            (*this)();
+        }
+    }
+    for (int i = 0; i < 4; i++)
+        s[i] = t[i];
+}
+
+Pcg64::Pcg64(std::uint64_t seed, std::uint64_t stream)
+    : state(0), increment((unsigned __int128)stream << 1 | 1)
+{
+    // the seeding of the reference pcg64_srandom_r()
+    (*this)();
+    state += seed;
+    (*this)();
+}
+
+Xoshiro256& ThreadRandom()
+{
+    return threadGenerator();
+}
+
+void SeedRandom(std::uint64_t seed)
+{
+    {
+        std::lock_guard<std::mutex> hold(masterLock);
+        master = Xoshiro256(seed);
+    }
+    threadGenerator() = nextStream();
+}
+
+std::uint64_t RandomBounded(std::uint64_t range)
+{
+    return Bounded(threadGenerator(), range);
+}
+
+double RandomUniform()
+{
+    return Uniform(threadGenerator());
+}
+
+void RandomUniforms(double* x, std::size_t n)
+{
+    // a copy in a register for the loop, rather than the thread's in memory
+    Xoshiro256 g = threadGenerator();
+    for (std::size_t i = 0; i < n; i++)
+        x[i] = Uniform(g);
+    threadGenerator() = g;
+}
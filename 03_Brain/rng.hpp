@@ -0,0 +1,120 @@
+//
+//  rng.hpp
+//  TestingGh
+//
+//  Random numbers for Guessing(), guessingInt() and the simulations built on them:
+//
+//      Xoshiro256      xoshiro256** of Blackman and Vigna, 256 bits of state, the default
+//      Pcg64           PCG64 (XSL RR 128/64) of O'Neill, for a second, unrelated generator
+//      Bounded(g, n)   an integer in [0, n) with no modulo bias, by Lemire's multiply and reject
+//      Uniform(g)      a double in [0, 1), from the top 53 bits
+//
+//  Both generators work with the <random> distributions too. RandomBounded(), RandomUniform()
+//  and RandomUniforms() draw from the calling thread's own Xoshiro256, so threads neither share
+//  state nor wait for one another. Each thread's stream starts 2^128 draws after the last
+//  one's (jump()), so the streams never overlap; the same seed gives the same stream to the
+//  first thread, the next to the second, and so on. SeedRandom() sets the seed, which is fixed
+//  unless it is called, as it was with std::rand().
+//
+
+#ifndef rng_hpp
+#define rng_hpp
+#include <cstddef>
+#include <cstdint>
+
+class Xoshiro256
+{
+public:
+    typedef std::uint64_t result_type;
+
+    // the state from SplitMix64 of seed, as the authors recommend
+    explicit Xoshiro256(std::uint64_t seed = 0);
+
+    static constexpr result_type min()  { return 0; }
+    static constexpr result_type max()  { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        const std::uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const std::uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // as if 2^128 values had been drawn; for streams that do not overlap
+    void jump();
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k)  { return (x << k) | (x >> (64 - k)); }
+
+    std::uint64_t s[4];
+};
+
+class Pcg64
+{
+public:
+    typedef std::uint64_t result_type;
+
+    // stream picks one of 2^64 of the 2^127 sequences; different streams are unrelated
+    explicit Pcg64(std::uint64_t seed = 0, std::uint64_t stream = 0);
+
+    static constexpr result_type min()  { return 0; }
+    static constexpr result_type max()  { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        state = state * multiplier() + increment;
+        std::uint64_t x = std::uint64_t(state >> 64) ^ std::uint64_t(state);
+        unsigned rot = unsigned(state >> 122);
+        return (x >> rot) | (x << ((64 - rot) & 63));
+    }
+
+private:
+    static unsigned __int128 multiplier()
+    {
+        return (unsigned __int128)0x2360ed051fc65da4ull << 64 | 0x4385df649fccf645ull;
+    }
+
+    unsigned __int128 state;
+    unsigned __int128 increment;
+};
+
+// an integer in [0, range), every one equally likely; range must not be 0. One multiply, and a
+// division only when the low half lands in the few values that would bias the result
+template <typename Generator> std::uint64_t Bounded(Generator& g, std::uint64_t range)
+{
+    unsigned __int128 m = (unsigned __int128)g() * range;
+    std::uint64_t low = std::uint64_t(m);
+    if (low < range){
+        const std::uint64_t threshold = (0 - range) % range;
+        while (low < threshold){
+            m = (unsigned __int128)g() * range;
+            low = std::uint64_t(m);
+        }
+    }
+    return std::uint64_t(m >> 64);
+}
+
+// a double in [0, 1), a multiple of 2^-53
+template <typename Generator> double Uniform(Generator& g)
+{
+    return double(g() >> 11) * 0x1.0p-53;
+}
+
+// the calling thread's generator
+Xoshiro256& ThreadRandom();
+// the seed of the streams of threads that draw for the first time after the call, and a new
+// stream from it for the calling thread
+void SeedRandom(std::uint64_t seed);
+
+std::uint64_t RandomBounded(std::uint64_t range);
+double RandomUniform();
+// n doubles in [0, 1)
+void RandomUniforms(double* x, std::size_t n);
+
+#endif /* rng_hpp */